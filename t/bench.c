@@ -0,0 +1,116 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "uri.h"
+
+#define ROUNDS 200000
+
+static const char *bench_uris[] = {
+	"http://www.example.com/"
+,	"https://api.example.com/v1/users/12345/orders?page=2&limit=50"
+,	"http://en.wikipedia.org/wiki/URI#Examples_of_URI_references"
+,	"https://cdn.example.net:8443/static/js/app.min.js?v=3f2a9c"
+,	"http://127.0.0.1:9999/"
+,	"https://www.google.com/?q=URI+percent+encoding+!*'()%3B%3A%40%26%3D%2B%24%2C%2F%3F%23%5B%5D"
+,	"ftp://ftp.is.co.za/rfc/rfc1808.txt"
+,	"mailto:John.Doe@example.com"
+};
+
+#define N_URIS (sizeof(bench_uris)/sizeof(bench_uris[0]))
+
+#define DATA_PAYLOAD (4 * 1024 * 1024)
+#define DATA_ROUNDS  50
+
+static double seconds(clock_t start)
+{
+	return (double)(clock() - start) / CLOCKS_PER_SEC;
+}
+
+int main(void)
+{
+	size_t lens[N_URIS], total = 0, sink = 0;
+	clock_t start;
+	double t;
+
+	for (size_t i = 0; i < N_URIS; i++)
+		lens[i] = strlen(bench_uris[i]);
+
+	start = clock();
+	for (unsigned int r = 0; r < ROUNDS; r++)
+	{
+		for (size_t i = 0; i < N_URIS; i++)
+		{
+			uri_t uri;
+			uri_state_t s = uri_init(&uri, bench_uris[i]);
+
+			while (s != URI_PARSE_DONE && s != URI_PARSE_ERROR)
+				s = uri_parse_next_component(&uri);
+
+			sink += uri_get_bytes_parsed(&uri);
+		}
+	}
+	t = seconds(start);
+	total = sink;
+	printf("uri_parse_next_component: %8.1f ns/uri %8.1f MB/s\n", t * 1e9 / ((double)ROUNDS * N_URIS), (double)total / t / 1e6);
+
+	sink = 0;
+	start = clock();
+	for (unsigned int r = 0; r < ROUNDS; r++)
+	{
+		for (size_t i = 0; i < N_URIS; i++)
+		{
+			size_t off;
+			uri_validate(bench_uris[i], lens[i], &off);
+			sink += off;
+		}
+	}
+	t = seconds(start);
+	printf("uri_validate:             %8.1f ns/uri %8.1f MB/s\n", t * 1e9 / ((double)ROUNDS * N_URIS), (double)sink / t / 1e6);
+
+	if (sink != total) return 1;
+
+	{
+		static const char prefix[] = "data:image/png;base64,";
+		char *uri = malloc(sizeof(prefix) + DATA_PAYLOAD), *out = malloc(DATA_PAYLOAD);
+		uri_data_t data;
+
+		if (uri == NULL || out == NULL) return 1;
+
+		memcpy(uri, prefix, sizeof(prefix) - 1);
+		for (size_t i = 0; i < DATA_PAYLOAD; i++)
+			uri[sizeof(prefix) - 1 + i] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/"[(unsigned int)(i * 2654435761u) >> 26];
+		uri[sizeof(prefix) - 1 + DATA_PAYLOAD] = '\0';
+
+		start = clock();
+		for (unsigned int r = 0; r < DATA_ROUNDS; r++)
+		{
+			size_t pos = 0, n = 0;
+			uri_parse_data(&data, uri, sizeof(prefix) - 1 + DATA_PAYLOAD, NULL);
+			uri_data_decode(&data, uri, &pos, out, DATA_PAYLOAD, &n);
+			total += n;
+		}
+		t = seconds(start);
+		printf("uri_data_decode:          %8.1f MB/s of base64\n", (double)DATA_PAYLOAD * DATA_ROUNDS / t / 1e6);
+
+		free(uri);
+		free(out);
+	}
+
+	{
+		static const char *values[] = { "12345", "2", "50" };
+		uri_template_t tpl;
+		char out[128];
+
+		if (uri_template_compile(&tpl, "/users/{id}/orders{?page,limit}", NULL) != URI_PARSE_DONE) return 1;
+
+		start = clock();
+		for (unsigned int r = 0; r < ROUNDS * N_URIS; r++)
+			total += uri_template_expand(&tpl, values, out);
+		t = seconds(start);
+		printf("uri_template_expand:      %8.1f ns/uri\n", t * 1e9 / ((double)ROUNDS * N_URIS));
+	}
+
+	return 0;
+}
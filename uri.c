@@ -1,4 +1,11 @@
 #include <stddef.h>
+#include <string.h>
+
+#if defined(__GNUC__) && defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__GNUC__) && defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
 #include "uri.h"
 
@@ -10,6 +17,17 @@
 #define UNRESERVED  0x20
 #define PCHAR       0x40
 
+/*
+ * Schemes with a specialized parse path. These always carry an authority
+ * that is almost always a plain reg-name, so the fast path matches
+ * "scheme://host" directly. It skips the userinfo lookahead and the host
+ * alternatives, and leaves anything unusual to the generic productions.
+ * Define URI_NO_FAST_SCHEMES to parse everything generically.
+ */
+#define URI_FAST_SCHEME_MAP(F)	\
+	F(http,		"http")		\
+	F(https,	"https")	\
+
 #define A (unsigned char)ALPHA
 #define D (unsigned char)DIGIT
 #define H (unsigned char)HEXIDECIMAL
@@ -96,6 +114,8 @@ static inline const char* scout_path_empty(const char*) __pure;
 static inline const char* scout_userinfo(const char*) __pure;
 static inline const char* scout_port(const char*) __pure;
 static inline const char* scout_scheme(const char*) __pure;
+static inline const char* scout_fast_scheme(const char*) __pure;
+static inline const char* scout_fast_host(const char*) __pure;
 
 /*
  * dec-octet = DIGIT             ;   0-9
@@ -106,30 +126,24 @@ static inline const char* scout_scheme(const char*) __pure;
  */
 static inline const char* scout_dec_octet(const char *c)
 {
+	if (!(ascii_flags[(unsigned char)*c] & DIGIT)) return NULL;
+	if (*c == '0' || !(ascii_flags[(unsigned char)*(c + 1)] & DIGIT)) return c;
+	if (!(ascii_flags[(unsigned char)*(c + 2)] & DIGIT)) return c + 1;
+
 	switch (*c)
 	{
 	case '1':
 
-		if ((ascii_flags[(unsigned char)*(c + 1)] & DIGIT) && (ascii_flags[(unsigned char)*(c + 2)] & DIGIT)) return c + 2;
-		else if (ascii_flags[(unsigned char)*(c + 1)] & DIGIT) return c + 1;
-		else return NULL;
+		return c + 2;
 
 	case '2':
 
-		if ((*(c + 1) - '0') <= ('5' - '0')) {
-			if ((*(c + 1) == '5') && ((*(c + 2) - '0') <= ('5' - '0'))) return c + 2;
-			else if (ascii_flags[(unsigned char)*(c + 2)] & DIGIT) return c + 2;
-			else return NULL; 
-		}
-		else return NULL;
+		if (*(c + 1) < '5' || (*(c + 1) == '5' && *(c + 2) <= '5')) return c + 2;
+		else return c + 1;
 
 	default:
 
-		if (ascii_flags[(unsigned char)*c] & DIGIT) {
-			if (((*c - '3') <= ('9' - '3')) && (ascii_flags[(unsigned char)*(c + 1)] & DIGIT)) return c + 1;
-			else return c;
-		}
-		else return NULL;
+		return c + 1;
 	}
 }
 
@@ -224,27 +238,35 @@ static inline const char* scout_ipv6address(const char *c)
 
 	if ((p = scout_ipv6address_rh6(c)) != NULL) return p;
 	else {
-		p = c;
+		p = c - 1;
 		c = scout_h16(c);
 		while (c != NULL)
 		{
 			p = c++;
 			left_hand_count++;
-			if (*c == ':') c = scout_h16(c + 1);
+			c = (*c == ':') ? scout_h16(c + 1) : NULL;
 		}
 
-		p += (left_hand_count == 0) ? 2 : 3;
+		if (*(p + 1) != ':' || *(p + 2) != ':') return NULL;
+		p += 3;
 
 		switch (left_hand_count)
 		{
 		case 0: if ((c = scout_ipv6address_rh5(p)) != NULL) return c;
+			/* fall through */
 		case 1: if ((c = scout_ipv6address_rh4(p)) != NULL) return c;
+			/* fall through */
 		case 2: if ((c = scout_ipv6address_rh3(p)) != NULL) return c;
+			/* fall through */
 		case 3: if ((c = scout_ipv6address_rh2(p)) != NULL) return c;
+			/* fall through */
 		case 4: if ((c = scout_ipv6address_rh1(p)) != NULL) return c;
+			/* fall through */
 		case 5: if ((c = scout_ls32(p)) != NULL) return c;
+			/* fall through */
 		case 6: if ((c = scout_h16(p)) != NULL) return c;
-		case 7: return p;
+			/* fall through */
+		case 7: return p - 1;
 		default: return NULL;
 		}
 	}
@@ -255,19 +277,21 @@ static inline const char* scout_ipv6address(const char *c)
  */
 static inline const char* scout_ipvfuture(const char *c)
 {
-	if (*c == 'v') {
+	const char *p = NULL;
+
+	if ((*c == 'v' || *c == 'V') && (ascii_flags[(unsigned char)*(c + 1)] & HEXIDECIMAL)) {
+		c++;
 		while (ascii_flags[(unsigned char)*c] & HEXIDECIMAL)
 			c++;
 
 		if (*c == '.') {
+			c++;
 			while ((ascii_flags[(unsigned char)*c] & (UNRESERVED | SUB_DELIM)) || *c == ':')
-				c++;
-
-			return c;
+				p = c++;
 		}
 	}
 
-	return NULL;
+	return p;
 }
 
 /*
@@ -367,15 +391,16 @@ static inline const char* scout_reg_name(const char *c)
  */
 static inline const char* scout_path_abempty(const char *c)
 {
-	const char *p = NULL;
+	const char *p = NULL, *s;
 
-	do
+	while (*c == '/')
 	{
-		if (*c != '/') break;
 		p = c++;
-		c = scout_segment(c);
-		if (c != NULL) p = c++;
-	} while (c != NULL);
+		if ((s = scout_segment(c)) != NULL) {
+			p = s;
+			c = s + 1;
+		}
+	}
 
 	return p;
 }
@@ -449,7 +474,7 @@ static inline const char* scout_path_empty(const char *c)
  */
 static inline const char* scout_userinfo(const char *c)
 {
-	const char *p = c;
+	const char *p = c - 1;
 
 	do
 	{
@@ -529,6 +554,163 @@ exit:
 	return p;
 }
 
+/*
+ * Byte-class kernels for the bounded entry points. These skip the longest
+ * run of path characters ( pchar / "/" ) or query characters ( pchar / "/"
+ * / "?" ) in [c, e), stopping at any "%" so the caller can check for
+ * pct-encoded. They never read at or beyond e, so they may use the widest
+ * vector unit available.
+ */
+#if defined(__GNUC__) && (defined(__AVX2__) || defined(__SSE2__))
+
+#if defined(__AVX2__)
+#define SKIM_WIDTH               32
+#define skim_vector_t            __m256i
+#define skim_load(c)             _mm256_loadu_si256((const __m256i *)(c))
+#define skim_set1                _mm256_set1_epi8
+#define skim_and                 _mm256_and_si256
+#define skim_or                  _mm256_or_si256
+#define skim_eq                  _mm256_cmpeq_epi8
+#define skim_gt                  _mm256_cmpgt_epi8
+#define skim_movemask(v)         ((unsigned int)_mm256_movemask_epi8(v))
+#define SKIM_ALL                 0xffffffffu
+#else
+#define SKIM_WIDTH               16
+#define skim_vector_t            __m128i
+#define skim_load(c)             _mm_loadu_si128((const __m128i *)(c))
+#define skim_set1                _mm_set1_epi8
+#define skim_and                 _mm_and_si128
+#define skim_or                  _mm_or_si128
+#define skim_eq                  _mm_cmpeq_epi8
+#define skim_gt                  _mm_cmpgt_epi8
+#define skim_movemask(v)         ((unsigned int)_mm_movemask_epi8(v))
+#define SKIM_ALL                 0xffffu
+#endif
+
+/* bytes above 0x7f compare negative and so never fall inside a range */
+#define skim_range(v, lo, hi)    skim_and(skim_gt(v, skim_set1((lo) - 1)), skim_gt(skim_set1((hi) + 1), v))
+#define skim_byte(v, x)          skim_eq(v, skim_set1(x))
+
+static inline unsigned int skim_mask(skim_vector_t v, int query)
+{
+	skim_vector_t m;
+
+	m = skim_or(skim_byte(v, '!'), skim_byte(v, '$'));
+	m = skim_or(m, skim_range(v, '&', ';'));
+	m = skim_or(m, skim_byte(v, '='));
+	m = skim_or(m, query ? skim_range(v, '?', 'Z') : skim_range(v, '@', 'Z'));
+	m = skim_or(m, skim_byte(v, '_'));
+	m = skim_or(m, skim_range(v, 'a', 'z'));
+	m = skim_or(m, skim_byte(v, '~'));
+
+	return skim_movemask(m);
+}
+
+#endif
+
+static inline const char* skim(const char *c, const char *e, int query)
+{
+#ifdef SKIM_WIDTH
+	while (e - c >= SKIM_WIDTH)
+	{
+		unsigned int m = ~skim_mask(skim_load(c), query) & SKIM_ALL;
+		if (m != 0) return c + __builtin_ctz(m);
+		c += SKIM_WIDTH;
+	}
+#endif
+
+	while (c < e && ((ascii_flags[(unsigned char)*c] & PCHAR) || *c == '/' || (query && *c == '?')))
+		c++;
+
+	return c;
+}
+
+/*
+ * *( pchar / "/" ) or *( pchar / "/" / "?" ) bounded by e
+ */
+static inline const char* skim_run(const char *c, const char *e, int query)
+{
+	for (;;)
+	{
+		c = skim(c, e, query);
+		if (e - c >= 3 && scout_pct_encoded(c) != NULL) c += 3;
+		else return c;
+	}
+}
+
+/*
+ * case-insensitive match of an all-ALPHA scheme name; a NUL never matches,
+ * so this stops at the end of the string
+ */
+static inline int match_scheme_name(const char *c, const char *name, size_t n)
+{
+	for (size_t i = 0; i < n; i++)
+	{
+		if ((*(c + i) | 0x20) != *(name + i)) return 0;
+	}
+
+	return 1;
+}
+
+/*
+ * fast-scheme = 1*( <each name in URI_FAST_SCHEME_MAP> ) ":"
+ */
+static inline const char* scout_fast_scheme(const char *c)
+{
+#define F(symbol, name) \
+	if (match_scheme_name(c, name, sizeof(name) - 1) && *(c + sizeof(name) - 1) == ':') return c + sizeof(name) - 2;
+	URI_FAST_SCHEME_MAP(F)
+#undef F
+
+	return NULL;
+}
+
+static inline int is_fast_scheme(const char *start, const char *end)
+{
+#define F(symbol, name) \
+	if ((size_t)(end - start) == sizeof(name) - 1 && match_scheme_name(start, name, sizeof(name) - 1)) return 1;
+	URI_FAST_SCHEME_MAP(F)
+#undef F
+
+	return 0;
+}
+
+/*
+ * A reg-name made only of unreserved / sub-delims, accepted when what
+ * follows it and an optional port cannot belong to a userinfo: a path,
+ * query or fragment delimiter or a non-URI byte. On anything else
+ * (pct-encoded, "@", IP literals, an empty host) return NULL, and the
+ * generic productions decide.
+ */
+static inline const char* scout_fast_host(const char *c)
+{
+	const char *p = NULL;
+
+	while (ascii_flags[(unsigned char)*c] & (UNRESERVED | SUB_DELIM))
+		p = c++;
+
+	if (p == NULL) return NULL;
+
+	if (*c == ':') {
+		c++;
+		while (ascii_flags[(unsigned char)*c] & DIGIT)
+			c++;
+	}
+
+	switch (*c)
+	{
+	case '/':
+	case '?':
+	case '#':
+
+		return p;
+
+	default:
+
+		return (ascii_flags[(unsigned char)*c] == 0 && *c != '%') ? p : NULL;
+	}
+}
+
 static uri_state_t proceed(const char ** const start, const char ** const end, uri_state_t in_state)
 {
 	int relative_ref = 0;
@@ -542,6 +724,13 @@ static uri_state_t proceed(const char ** const start, const char ** const end, u
 
 	case URI_PARSE_RESET:
 
+#ifndef URI_NO_FAST_SCHEMES
+		if ((*end = scout_fast_scheme(*start)) != NULL) {
+			(*end)++;
+			return URI_HAS_SCHEME;
+		}
+#endif
+
 		if ((*end = scout_scheme(*start)) != NULL) {
 			if (*(*end + 1) == ':') {
 				(*end)++;
@@ -563,6 +752,17 @@ static uri_state_t proceed(const char ** const start, const char ** const end, u
 
 		if (**end != ':') return URI_PARSE_ERROR;
 
+#ifndef URI_NO_FAST_SCHEMES
+		if (is_fast_scheme(*start, *end) && *(*end + 1) == '/' && *(*end + 2) == '/') {
+			const char *p = scout_fast_host(*end + 3);
+			if (p != NULL) {
+				*start = *end + 3;
+				*end = p + 1;
+				return URI_HAS_HOST;
+			}
+		}
+#endif
+
 		*start = ++(*end);
 
 proceed_relative_ref:
@@ -571,9 +771,8 @@ proceed_relative_ref:
 		{
 		case '/':
 
-			(*start)++;
-			if (**start == '/') {
-				(*start)++;
+			if (*(*start + 1) == '/') {
+				*start += 2;
 				if ((*end = scout_userinfo(*start)) != NULL) {
 					(*end)++; 
 					return URI_HAS_USERINFO;
@@ -585,7 +784,7 @@ proceed_relative_ref:
 				(*end)++;
 				return URI_HAS_PATH;
 			}
-			else return URI_HAS_PATH;
+			else return URI_PARSE_ERROR;
 
 		default:
 			if (relative_ref && ((*end = scout_path_noscheme(*start)) != NULL)) {
@@ -596,8 +795,8 @@ proceed_relative_ref:
 				(*end)++;
 				return URI_HAS_PATH;
 			}
-			else if ((*end = scout_path_empty(*start)) != NULL) {
-				(*end)++;
+			else if (scout_path_empty(*start) != NULL) {
+				*end = *start;
 				return URI_HAS_EMPTY_PATH;
 			}
 			else return URI_PARSE_ERROR;
@@ -657,14 +856,10 @@ proceed_path_abempty:
 		case '?':
 
 			(*start)++;
-			if ((*end = scout_query(*start)) != NULL) {
-				(*end)++;
-				return URI_HAS_QUERY;
-			}
-			else {
-				*end = *start;
-				return URI_PARSE_DONE;
-			}
+			if ((*end = scout_query(*start)) != NULL) (*end)++;
+			else *end = *start;
+
+			return URI_HAS_QUERY;
 
 		case '#':
 
@@ -687,14 +882,10 @@ proceed_path_abempty:
 proceed_fragment:
 
 			(*start)++;
-			if ((*end = scout_fragment(*start)) != NULL) {
-				(*end)++;
-				return URI_HAS_FRAGMENT;
-			}
-			else {
-				*end = *start;
-				return URI_PARSE_DONE;
-			}
+			if ((*end = scout_fragment(*start)) != NULL) (*end)++;
+			else *end = *start;
+
+			return URI_HAS_FRAGMENT;
 
 		default:
 
@@ -735,6 +926,11 @@ const char* uri_get_component_pointer(const uri_t *uri)
 	return uri->start;
 }
 
+size_t uri_get_component_offset(const uri_t *uri)
+{
+	return (uri->start - uri->data);
+}
+
 size_t uri_get_component_size(const uri_t *uri)
 {
 	return (uri->end - uri->start);
@@ -749,3 +945,1660 @@ uri_state_t uri_parse_next_component(uri_t *uri)
 {
 	return (uri->state = proceed(&uri->start, &uri->end, uri->state));
 }
+
+/*
+ * Recognize a URI-reference of exactly len bytes without extracting its
+ * components. The productions are tried in the same order as proceed(), so
+ * the result always matches driving uri_parse_next_component() from
+ * URI_PARSE_RESET and checking that URI_PARSE_DONE is reached after len
+ * bytes. Like the NUL of a C string, uridata[len] must be readable and must
+ * not be a URI character.
+ */
+uri_state_t uri_validate(const char *uridata, size_t len, size_t *err_off)
+{
+	const char *c = uridata, *e = uridata + len, *p;
+	int relative_ref = 0, authority = 0;
+
+#ifndef URI_NO_FAST_SCHEMES
+	if ((p = scout_fast_scheme(c)) != NULL && *(p + 2) == '/' && *(p + 3) == '/' && (p = scout_fast_host(p + 4)) != NULL) {
+		c = p + 1;
+		authority = 1;
+	}
+#endif
+
+	if (!authority) {
+		if ((p = scout_scheme(c)) != NULL && *(p + 1) == ':') c = p + 2;
+		else relative_ref = 1;
+
+		if (*c == '/' && *(c + 1) == '/') {
+			c += 2;
+			if ((p = scout_userinfo(c)) != NULL) c = p + 2;
+			if ((p = scout_host(c)) != NULL) c = p + 1;
+			authority = 1;
+		}
+		else if (*c == '/') {
+			c = skim_run(c, e, 0);
+		}
+		else if (relative_ref && (p = scout_segment_nz_nc(c)) != NULL) {
+			c = p + 1;
+			if (*c == '/') c = skim_run(c, e, 0);
+		}
+		else if (scout_pchar(c) != NULL) {
+			c = skim_run(c, e, 0);
+		}
+	}
+
+	if (authority) {
+		if (*c == ':' && (p = scout_port(c + 1)) != NULL) c = p + 1;
+		if (*c == '/') c = skim_run(c, e, 0);
+	}
+
+	if (*c == '?') c = skim_run(c + 1, e, 1);
+	if (*c == '#') c = skim_run(c + 1, e, 1);
+
+	if (err_off != NULL) *err_off = c - uridata;
+	return (c == e) ? URI_PARSE_DONE : URI_PARSE_ERROR;
+}
+
+static inline void target_component(uri_target_t *target, uri_state_t s, const char *base, const char *start, const char *end)
+{
+	target->components |= 1u << s;
+	target->component[s].offset = start - base;
+	target->component[s].size = end - start;
+}
+
+/*
+ * Parse the request-target of an HTTP request line, len bytes at target
+ * (RFC 9112 3.2). The form follows from the first byte and from
+ * URI_TARGET_CONNECT in flags, and anything that does not conform to
+ * that form is rejected as soon as it is seen:
+ *
+ *   origin-form    = absolute-path [ "?" query ]
+ *   absolute-form  = absolute-URI
+ *   authority-form = uri-host ":" port          ; CONNECT only
+ *   asterisk-form  = "*"
+ *
+ * The components are recorded with the spans uri_parse_next_component()
+ * would give them. As with uri_validate(), target[len] must be readable
+ * and must not be a URI character; the SP that ends a request-target
+ * qualifies. Returns URI_PARSE_DONE or URI_PARSE_ERROR, and stores the
+ * offset of the first byte not accepted.
+ */
+uri_state_t uri_parse_request_target(uri_target_t *target, const char *data, size_t len, unsigned int flags, size_t *err_off)
+{
+	const char *c = data, *e = data + len, *p;
+
+	memset(target, 0, sizeof(*target));
+
+	if (flags & URI_TARGET_CONNECT) {
+		target->form = URI_TARGET_AUTHORITY;
+
+		if ((p = scout_host(c)) == NULL) goto error;
+		target_component(target, URI_HAS_HOST, data, c, p + 1);
+		c = p + 1;
+
+		if (*c != ':') goto error;
+		if ((p = scout_port(++c)) == NULL) goto error;
+		target_component(target, URI_HAS_PORT, data, c, p + 1);
+		c = p + 1;
+	}
+	else if (*c == '*' && len == 1) {
+		target->form = URI_TARGET_ASTERISK;
+		c++;
+	}
+	else if (*c == '/') {
+		target->form = URI_TARGET_ORIGIN;
+
+		p = skim_run(c, e, 0);
+		target_component(target, URI_HAS_PATH, data, c, p);
+		c = p;
+
+		if (*c == '?') {
+			p = skim_run(c + 1, e, 1);
+			target_component(target, URI_HAS_QUERY, data, c + 1, p);
+			c = p;
+		}
+	}
+	else {
+		target->form = URI_TARGET_ABSOLUTE;
+
+		if ((p = scout_scheme(c)) == NULL || *(p + 1) != ':') goto error;
+		target_component(target, URI_HAS_SCHEME, data, c, p + 1);
+		c = p + 2;
+
+		if (*c == '/' && *(c + 1) == '/') {
+			c += 2;
+
+			if ((p = scout_userinfo(c)) != NULL) {
+				target_component(target, URI_HAS_USERINFO, data, c, p + 1);
+				c = p + 2;
+			}
+
+			if ((p = scout_host(c)) != NULL) {
+				target_component(target, URI_HAS_HOST, data, c, p + 1);
+				c = p + 1;
+			}
+
+			if (*c == ':' && (p = scout_port(c + 1)) != NULL) {
+				target_component(target, URI_HAS_PORT, data, c + 1, p + 1);
+				c = p + 1;
+			}
+
+			p = (*c == '/') ? skim_run(c, e, 0) : c;
+		}
+		else p = (*c == '/' || scout_pchar(c) != NULL) ? skim_run(c, e, 0) : c;
+
+		target_component(target, (p > c) ? URI_HAS_PATH : URI_HAS_EMPTY_PATH, data, c, p);
+		c = p;
+
+		if (*c == '?') {
+			p = skim_run(c + 1, e, 1);
+			target_component(target, URI_HAS_QUERY, data, c + 1, p);
+			c = p;
+		}
+	}
+
+	if (c != e) goto error;
+
+	if (err_off != NULL) *err_off = len;
+	return URI_PARSE_DONE;
+
+error:
+
+	if (err_off != NULL) *err_off = c - data;
+	return URI_PARSE_ERROR;
+}
+
+/*
+ * RFC 3986 6.2.2 equivalence, compared as normalized token streams so
+ * that no normalized copy is ever built. A token is an octet, with
+ * pct-encoded unreserved characters decoded, other pct-encoded octets
+ * kept apart from their literal form, and letters optionally folded. A
+ * "%" that does not start a pct-encoded triple is an ordinary octet.
+ */
+#define TOKEN_END		-1
+#define TOKEN_PCT_ENCODED	0x100
+
+static inline int hex_value(char c)
+{
+	return (ascii_flags[(unsigned char)c] & DIGIT) ? c - '0' : (c | 0x20) - 'a' + 10;
+}
+
+static inline int next_token(const char **c, const char *e, int fold)
+{
+	int t;
+
+	if (*c >= e) return TOKEN_END;
+
+	if (**c == '%' && e - *c >= 3 && scout_pct_encoded(*c) != NULL) {
+		t = (hex_value(*(*c + 1)) << 4) | hex_value(*(*c + 2));
+		if (!(ascii_flags[t] & UNRESERVED)) t |= TOKEN_PCT_ENCODED;
+		*c += 3;
+	}
+	else t = (unsigned char)*(*c)++;
+
+	return (fold && t >= 'A' && t <= 'Z') ? (t | 0x20) : t;
+}
+
+static int tokens_equal(const char *a, const char *ae, const char *b, const char *be, int fold)
+{
+	int t;
+
+	do
+	{
+		if ((t = next_token(&a, ae, fold)) != next_token(&b, be, fold)) return 0;
+	} while (t != TOKEN_END);
+
+	return 1;
+}
+
+static inline const char* segment_end(const char *c, const char *e)
+{
+	while (c < e && *c != '/')
+		c++;
+
+	return c;
+}
+
+static inline const char* next_segment(const char *end, const char *e)
+{
+	return (end < e) ? end + 1 : NULL;
+}
+
+/*
+ * 1 for ".", 2 for "..", in either literal or pct-encoded form
+ */
+static int dot_segment(const char *c, const char *e)
+{
+	int n, t = TOKEN_END;
+
+	for (n = 0; n < 3; n++)
+	{
+		if ((t = next_token(&c, e, 0)) != '.') break;
+	}
+
+	return (n > 0 && n < 3 && t == TOKEN_END) ? n : 0;
+}
+
+static int has_dot_segment(const char *c, const char *e)
+{
+	for (; c != NULL; c = next_segment(segment_end(c, e), e))
+	{
+		if (dot_segment(c, segment_end(c, e))) return 1;
+	}
+
+	return 0;
+}
+
+/*
+ * remove_dot_segments() walked backwards, from the end of an absolute path
+ * towards its leading "/": a ".." pops the next normal segment to its left,
+ * so a count of pending ".." segments decides each segment as it is met.
+ * Every segment is visited once, with no buffer.
+ */
+typedef struct dot_walk_t
+{
+	const char *start;
+	const char *end;
+	size_t pending;
+	int last;
+} dot_walk_t;
+
+/*
+ * Step back to the previous segment remove_dot_segments() would output.
+ * A final "." or ".." leaves an empty segment behind (a trailing "/").
+ */
+static int prev_kept_segment(dot_walk_t *w, const char **s, const char **se)
+{
+	while (w->end != NULL)
+	{
+		const char *end = w->end, *c = end;
+		int dot;
+
+		while (c > w->start && *(c - 1) != '/')
+			c--;
+
+		w->end = (c > w->start) ? c - 1 : NULL;
+		dot = dot_segment(c, end);
+
+		if (dot == 2) w->pending++;
+
+		if (w->last) {
+			w->last = 0;
+			if (dot) {
+				*s = *se = end;
+				return 1;
+			}
+		}
+
+		if (dot) continue;
+		else if (w->pending > 0) w->pending--;
+		else {
+			*s = c;
+			*se = end;
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+static int dot_paths_equal(const char *a, const char *ae, const char *b, const char *be)
+{
+	dot_walk_t wa = { a + 1, ae, 0, 1 }, wb = { b + 1, be, 0, 1 };
+	const char *sa, *sae, *sb, *sbe;
+	int ka, kb;
+
+	for (;;)
+	{
+		ka = prev_kept_segment(&wa, &sa, &sae);
+		kb = prev_kept_segment(&wb, &sb, &sbe);
+		if (ka != kb) return 0;
+		if (!ka) return 1;
+		if (!tokens_equal(sa, sae, sb, sbe, 0)) return 0;
+	}
+}
+
+/*
+ * Compare absolute paths segment by segment. Until a dot-segment shows up
+ * the first differing segment decides, provided no dot-segment follows
+ * that could still pop it; only then are kept segments worked out.
+ */
+static int paths_equal(const char *a, const char *ae, const char *b, const char *be)
+{
+	const char *pa, *pb, *sa, *sb;
+
+	if (a == ae || b == be || *a != '/' || *b != '/') return tokens_equal(a, ae, b, be, 0);
+
+	for (pa = a + 1, pb = b + 1; ; pa = sa + 1, pb = sb + 1)
+	{
+		sa = segment_end(pa, ae);
+		sb = segment_end(pb, be);
+
+		if (dot_segment(pa, sa) || dot_segment(pb, sb)) return dot_paths_equal(a, ae, b, be);
+
+		if (!tokens_equal(pa, sa, pb, sb, 0) || (sa == ae) != (sb == be)) {
+			if (has_dot_segment(pa, ae) || has_dot_segment(pb, be)) return dot_paths_equal(a, ae, b, be);
+			return 0;
+		}
+
+		if (sa == ae) return 1;
+	}
+}
+
+static int components_equal(uri_state_t s, const uri_t *a, const uri_t *b)
+{
+	switch (s)
+	{
+	case URI_HAS_SCHEME:
+	case URI_HAS_HOST:
+
+		return tokens_equal(a->start, a->end, b->start, b->end, 1);
+
+	case URI_HAS_PATH:
+	case URI_HAS_EMPTY_PATH:
+
+		return paths_equal(a->start, a->end, b->start, b->end);
+
+	default:
+
+		return tokens_equal(a->start, a->end, b->start, b->end, 0);
+	}
+}
+
+/*
+ * Decide whether two URI-references are equivalent under case,
+ * percent-encoding and path segment normalization (RFC 3986 6.2.2),
+ * walking both a component at a time and stopping at the first
+ * difference. Dot-segments are only resolved in absolute paths.
+ */
+int uri_equivalent(const char *a, const char *b)
+{
+	uri_t ua, ub;
+	uri_state_t sa = uri_init(&ua, a), sb = uri_init(&ub, b);
+
+	while (sa != URI_PARSE_DONE)
+	{
+		sa = uri_parse_next_component(&ua);
+		sb = uri_parse_next_component(&ub);
+
+		if (sa == URI_HAS_EMPTY_PATH) sa = URI_HAS_PATH;
+		if (sb == URI_HAS_EMPTY_PATH) sb = URI_HAS_PATH;
+
+		if (sa != sb || sa == URI_PARSE_ERROR) return 0;
+		if (sa != URI_PARSE_DONE && !components_equal(sa, &ua, &ub)) return 0;
+	}
+
+	return (*ua.end == '\0' && *ub.end == '\0');
+}
+
+/*
+ * data: URIs (RFC 2397)
+ *
+ *   dataurl   = "data:" [ mediatype ] [ ";base64" ] "," data
+ *   mediatype = [ type "/" subtype ] *( ";" parameter )
+ *   parameter = attribute "=" value
+ *
+ * The mediatype and parameters are checked as pchar runs without ";",
+ * "," or "?". A base64 payload is only located here (it ends at "#" or
+ * at len) and is checked by uri_data_decode() while it is decoded, so
+ * a payload of several megabytes is read once, not twice.
+ */
+static inline const char* scout_data_token(const char *c, const char *e, char stop)
+{
+	while (c < e && *c != ';' && *c != ',' && *c != stop)
+	{
+		if (ascii_flags[(unsigned char)*c] & PCHAR || *c == '/') c++;
+		else if (e - c >= 3 && scout_pct_encoded(c) != NULL) c += 3;
+		else break;
+	}
+
+	return c;
+}
+
+uri_state_t uri_parse_data(uri_data_t *data, const char *uridata, size_t len, size_t *err_off)
+{
+	const char *c = uridata, *e = uridata + len, *p;
+	size_t n, pct = 0;
+
+	memset(data, 0, sizeof(*data));
+
+	if (len < 5 || !match_scheme_name(c, "data", 4) || *(c + 4) != ':') goto error;
+	c += 5;
+
+	p = scout_data_token(c, e, 0);
+	data->mediatype.offset = c - uridata;
+	data->mediatype.size = p - c;
+	data->parameters.offset = p - uridata;
+	c = p;
+
+	while (c < e && *c == ';')
+	{
+		if (e - c >= 8 && memcmp(c + 1, "base64,", 7) == 0) {
+			data->base64 = 1;
+			data->parameters.size = c - uridata - data->parameters.offset;
+			c += 7;
+			break;
+		}
+
+		if ((p = scout_data_token(c + 1, e, '=')) == c + 1 || *p != '=') {
+			c = p;
+			goto error;
+		}
+
+		c = scout_data_token(p + 1, e, 0);
+		data->parameters.size = c - uridata - data->parameters.offset;
+	}
+
+	if (c >= e || *c != ',') goto error;
+	data->data.offset = ++c - uridata;
+
+	if (data->base64) {
+		if ((p = memchr(c, '#', e - c)) == NULL) p = e;
+		data->data.size = p - c;
+
+		n = data->data.size;
+		while (n > 0 && *(c + n - 1) == '=' && data->data.size - n < 2)
+			n--;
+		data->size = n / 4 * 3 + ((n % 4 > 1) ? n % 4 - 1 : 0);
+		c = p;
+	}
+	else {
+		for (;;)
+		{
+			c = skim(c, e, 1);
+			if (e - c >= 3 && scout_pct_encoded(c) != NULL) c += 3, pct++;
+			else break;
+		}
+
+		data->data.size = c - uridata - data->data.offset;
+		data->size = data->data.size - 2 * pct;
+	}
+
+	if (c < e && *c == '#') c = skim_run(c + 1, e, 1);
+	if (c != e) goto error;
+
+	if (err_off != NULL) *err_off = len;
+	return URI_PARSE_DONE;
+
+error:
+
+	if (err_off != NULL) *err_off = c - uridata;
+	return URI_PARSE_ERROR;
+}
+
+/*
+ * base64 decoding, a vector at a time while the input holds nothing but
+ * the 64 alphabet characters: translate each byte to its 6-bit value with
+ * range compares, merge pairs of values into 12 bits and pairs of those
+ * into 24, then store 3 bytes per 4 characters. Padding, errors and the
+ * tail fall through to the scalar loop, which pins down the offending
+ * byte.
+ */
+static inline int base64_value(char c)
+{
+	if (c >= 'A' && c <= 'Z') return c - 'A';
+	if (c >= 'a' && c <= 'z') return c - 'a' + 26;
+	if (c >= '0' && c <= '9') return c - '0' + 52;
+	if (c == '+') return 62;
+	if (c == '/') return 63;
+
+	return -1;
+}
+
+#ifdef SKIM_WIDTH
+
+#if defined(__AVX2__)
+#define base64_add               _mm256_add_epi8
+#define base64_set16             _mm256_set1_epi16
+#define base64_set32             _mm256_set1_epi32
+#define base64_sll16             _mm256_slli_epi16
+#define base64_srl16             _mm256_srli_epi16
+#define base64_sll32             _mm256_slli_epi32
+#define base64_srl32             _mm256_srli_epi32
+#else
+#define base64_add               _mm_add_epi8
+#define base64_set16             _mm_set1_epi16
+#define base64_set32             _mm_set1_epi32
+#define base64_sll16             _mm_slli_epi16
+#define base64_srl16             _mm_srli_epi16
+#define base64_sll32             _mm_slli_epi32
+#define base64_srl32             _mm_srli_epi32
+#endif
+
+static inline int base64_decode_vector(skim_vector_t v, unsigned char *o)
+{
+	skim_vector_t upper = skim_range(v, 'A', 'Z'), lower = skim_range(v, 'a', 'z'), digit = skim_range(v, '0', '9');
+	skim_vector_t plus = skim_byte(v, '+'), slash = skim_byte(v, '/'), shift;
+
+	if (skim_movemask(skim_or(skim_or(upper, lower), skim_or(digit, skim_or(plus, slash)))) != SKIM_ALL) return 0;
+
+	shift = skim_and(upper, skim_set1(-'A'));
+	shift = skim_or(shift, skim_and(lower, skim_set1(26 - 'a')));
+	shift = skim_or(shift, skim_and(digit, skim_set1(52 - '0')));
+	shift = skim_or(shift, skim_and(plus, skim_set1(62 - '+')));
+	shift = skim_or(shift, skim_and(slash, skim_set1(63 - '/')));
+	v = base64_add(v, shift);
+
+	v = skim_or(base64_sll16(skim_and(v, base64_set16(0x003f)), 6), base64_srl16(v, 8));
+	v = skim_or(base64_sll32(skim_and(v, base64_set32(0x0fff)), 12), base64_srl32(v, 16));
+
+#if defined(__AVX2__)
+	v = _mm256_shuffle_epi8(v, _mm256_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1,
+	                                             2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1));
+	v = _mm256_permutevar8x32_epi32(v, _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 3, 7));
+	_mm256_storeu_si256((__m256i *)o, v);
+#else
+	{
+		uint32_t lane[4];
+
+		_mm_storeu_si128((__m128i *)lane, v);
+		for (int i = 0; i < 4; i++, o += 3)
+		{
+			*o = (unsigned char)(lane[i] >> 16);
+			*(o + 1) = (unsigned char)(lane[i] >> 8);
+			*(o + 2) = (unsigned char)lane[i];
+		}
+	}
+#endif
+
+	return 1;
+}
+
+#endif
+
+static uri_state_t base64_decode(const char **c, const char *e, unsigned char **o, const unsigned char *oe)
+{
+#ifdef SKIM_WIDTH
+	/* the AVX2 store writes a whole vector, not just the 3/4 of it decoded */
+	while (e - *c >= SKIM_WIDTH && oe - *o >= SKIM_WIDTH && base64_decode_vector(skim_load(*c), *o))
+	{
+		*c += SKIM_WIDTH;
+		*o += SKIM_WIDTH / 4 * 3;
+	}
+#endif
+
+	while (*c < e)
+	{
+		size_t n = (e - *c < 4) ? (size_t)(e - *c) : 4, k;
+		uint32_t v = 0;
+		int x;
+
+		for (k = 0; k < n && *(*c + k) != '='; k++)
+		{
+			if ((x = base64_value(*(*c + k))) < 0) {
+				*c += k;
+				return URI_PARSE_ERROR;
+			}
+			v = (v << 6) | (uint32_t)x;
+		}
+
+		/* "=" pads only the last quantum, and only after 2 or 3 characters */
+		if (k < 2 || (k < n && (n != 4 || *c + n != e))) {
+			*c += k;
+			return URI_PARSE_ERROR;
+		}
+		else if (k == 2 && n == 4 && *(*c + 3) != '=') {
+			*c += 3;
+			return URI_PARSE_ERROR;
+		}
+
+		if ((size_t)(oe - *o) < k - 1) break;
+
+		v <<= 6 * (4 - k);
+		for (size_t i = 0; i < k - 1; i++)
+			*(*o)++ = (unsigned char)(v >> (16 - 8 * i));
+
+		*c += n;
+	}
+
+	return URI_PARSE_DONE;
+}
+
+/*
+ * Decode the payload of data, a data: URI parsed from uridata by
+ * uri_parse_data(), into out. Decoding starts at offset *pos into the
+ * payload and stops at its end or when out is full, leaving *pos past
+ * what was consumed; so a whole payload is decoded with a buffer of
+ * data->size bytes, and a long one can be streamed through a small
+ * buffer (at least 3 bytes) until *pos reaches data->data.size.
+ * Returns URI_PARSE_DONE, or URI_PARSE_ERROR with *pos at the first
+ * byte that is not valid base64, and stores the number of bytes written.
+ */
+uri_state_t uri_data_decode(const uri_data_t *data, const char *uridata, size_t *pos, char *out, size_t size, size_t *out_len)
+{
+	const char *start = uridata + data->data.offset, *c = start + *pos, *e = start + data->data.size;
+	unsigned char *o = (unsigned char *)out, *oe = o + size;
+	uri_state_t s = URI_PARSE_DONE;
+
+	if (data->base64) s = base64_decode(&c, e, &o, oe);
+	else {
+		while (c < e && o < oe)
+		{
+			const char *p;
+			size_t n = (size_t)(e - c) < (size_t)(oe - o) ? (size_t)(e - c) : (size_t)(oe - o);
+
+			if ((p = memchr(c, '%', n)) == NULL) p = c + n;
+			memcpy(o, c, p - c);
+			o += p - c;
+			c = p;
+
+			if (c < e && *c == '%' && o < oe) {
+				*o++ = (unsigned char)((hex_value(*(c + 1)) << 4) | hex_value(*(c + 2)));
+				c += 3;
+			}
+		}
+	}
+
+	*pos = c - start;
+	if (out_len != NULL) *out_len = o - (unsigned char *)out;
+	return s;
+}
+
+/*
+ * Host-grouped batch sort. The key of each URI is its case-folded host, a
+ * separator, then its path, read one symbol at a time: 0 once the key is
+ * exhausted, 1 for the separator, 2 + octet otherwise. An MSD radix sort
+ * over those symbols orders the batch without comparing whole strings.
+ * Buckets smaller than SORT_INSERTION_MAX are finished by insertion sort.
+ * All memory is the caller's scratch: a copy of the permutation plus a
+ * work stack, which can hold every pending range because pending ranges
+ * are disjoint and at least SORT_INSERTION_MAX long.
+ */
+#define SORT_BUCKETS		258
+#define SORT_INSERTION_MAX	16
+#define SORT_TASKS_MAX		1024
+#define SORT_PARALLEL_MIN	65536
+
+typedef struct sort_range_t
+{
+	size_t lo;
+	size_t hi;
+	size_t depth;
+} sort_range_t;
+
+static inline unsigned int sort_symbol(const uri_sort_key_t *k, size_t d)
+{
+	unsigned char c;
+
+	if (d < k->host.size) {
+		c = (unsigned char)*(k->data + k->host.offset + d);
+		return ((c >= 'A' && c <= 'Z') ? (c | 0x20) : c) + 2;
+	}
+
+	if (d == k->host.size) return 1;
+
+	d -= k->host.size + 1;
+	return (d < k->path.size) ? (unsigned char)*(k->data + k->path.offset + d) + 2u : 0;
+}
+
+static int sort_key_less(const uri_sort_key_t *a, const uri_sort_key_t *b, size_t d)
+{
+	for (;; d++)
+	{
+		unsigned int x = sort_symbol(a, d), y = sort_symbol(b, d);
+		if (x != y) return x < y;
+		if (x == 0) return 0;
+	}
+}
+
+static void sort_insertion(const uri_sort_key_t *keys, size_t *perm, size_t lo, size_t hi, size_t d)
+{
+	for (size_t i = lo + 1; i < hi; i++)
+	{
+		size_t v = perm[i], j = i;
+
+		while (j > lo && sort_key_less(&keys[v], &keys[perm[j - 1]], d))
+		{
+			perm[j] = perm[j - 1];
+			j--;
+		}
+
+		perm[j] = v;
+	}
+}
+
+/*
+ * Distribute perm[r.lo, r.hi) on the symbol at r.depth. Small buckets are
+ * finished here, larger ones are pushed onto the stack.
+ */
+static void sort_distribute(const uri_sort_key_t *keys, size_t *perm, size_t *tmp, sort_range_t r, sort_range_t *stack, size_t *top)
+{
+	size_t count[SORT_BUCKETS] = { 0 }, pos[SORT_BUCKETS];
+	size_t i, b, at;
+
+	for (i = r.lo; i < r.hi; i++)
+		count[sort_symbol(&keys[perm[i]], r.depth)]++;
+
+	for (b = 0, at = r.lo; b < SORT_BUCKETS; b++)
+	{
+		pos[b] = at;
+		at += count[b];
+	}
+
+	if (count[sort_symbol(&keys[perm[r.lo]], r.depth)] != r.hi - r.lo) {
+		for (i = r.lo; i < r.hi; i++)
+			tmp[pos[sort_symbol(&keys[perm[i]], r.depth)]++] = perm[i];
+
+		for (i = r.lo; i < r.hi; i++)
+			perm[i] = tmp[i];
+	}
+	else {
+		for (b = 0; b < SORT_BUCKETS; b++)
+			pos[b] += count[b];
+	}
+
+	/* bucket 0 holds exhausted keys, which are already in order */
+	for (b = 1; b < SORT_BUCKETS; b++)
+	{
+		sort_range_t sub = { pos[b] - count[b], pos[b], r.depth + 1 };
+
+		if (count[b] < 2) continue;
+		else if (count[b] < SORT_INSERTION_MAX) sort_insertion(keys, perm, sub.lo, sub.hi, sub.depth);
+		else stack[(*top)++] = sub;
+	}
+}
+
+/*
+ * Sort one range to completion using only the slice of the work stack
+ * that corresponds to it, so disjoint ranges can be sorted concurrently.
+ */
+static void sort_range(const uri_sort_key_t *keys, size_t *perm, size_t *tmp, sort_range_t *stack, sort_range_t r)
+{
+	size_t top = 0;
+
+	if (r.hi - r.lo < SORT_INSERTION_MAX) {
+		sort_insertion(keys, perm, r.lo, r.hi, r.depth);
+		return;
+	}
+
+	stack += r.lo / SORT_INSERTION_MAX;
+	stack[top++] = r;
+	while (top > 0)
+	{
+		r = stack[--top];
+		sort_distribute(keys, perm, tmp, r, stack, &top);
+	}
+}
+
+size_t uri_sort_scratch_size(size_t n)
+{
+	return n * sizeof(size_t) + (n / SORT_INSERTION_MAX + 1) * sizeof(sort_range_t);
+}
+
+/*
+ * Initialize a sort key from the host and path components of a URI.
+ */
+uri_state_t uri_init_sort_key(uri_sort_key_t *key, const char *uridata)
+{
+	uri_t uri;
+	uri_state_t s = uri_init(&uri, uridata);
+
+	key->data = uridata;
+	key->host.offset = key->host.size = 0;
+	key->path.offset = key->path.size = 0;
+
+	while (s != URI_PARSE_DONE && s != URI_PARSE_ERROR)
+	{
+		switch ((s = uri_parse_next_component(&uri)))
+		{
+		case URI_HAS_HOST:
+
+			key->host.offset = uri_get_component_offset(&uri);
+			key->host.size = uri_get_component_size(&uri);
+			break;
+
+		case URI_HAS_PATH:
+
+			key->path.offset = uri_get_component_offset(&uri);
+			key->path.size = uri_get_component_size(&uri);
+			break;
+
+		default:
+
+			break;
+		}
+	}
+
+	return s;
+}
+
+/*
+ * Order n keys by (case-folded host, path) into perm, a permutation of
+ * 0 .. n - 1; equal keys keep their input order. The start of each run of
+ * equal hosts is written to groups, which needs room for n + 1 entries
+ * and is terminated by n. Returns the number of host groups. scratch must
+ * hold uri_sort_scratch_size(n) bytes. With OpenMP, batches of
+ * SORT_PARALLEL_MIN or more keys are split across threads once the top
+ * levels have been distributed.
+ */
+size_t uri_sort_by_host(const uri_sort_key_t *keys, size_t n, size_t *perm, size_t *groups, void *scratch)
+{
+	size_t *tmp = scratch;
+	sort_range_t *stack = (sort_range_t *)(tmp + n);
+	sort_range_t tasks[SORT_TASKS_MAX], r = { 0, n, 0 };
+	size_t i, g, top = 0, n_tasks = 0, grain = (n >= SORT_PARALLEL_MIN) ? n / 64 : 0;
+
+	for (i = 0; i < n; i++)
+		perm[i] = i;
+
+	if (n >= SORT_INSERTION_MAX) {
+		stack[top++] = r;
+		while (top > 0)
+		{
+			r = stack[--top];
+			if (r.hi - r.lo < grain && n_tasks < SORT_TASKS_MAX) tasks[n_tasks++] = r;
+			else sort_distribute(keys, perm, tmp, r, stack, &top);
+		}
+	}
+	else sort_insertion(keys, perm, 0, n, 0);
+
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic, 1)
+#endif
+	for (long t = 0; t < (long)n_tasks; t++)
+		sort_range(keys, perm, tmp, stack, tasks[t]);
+
+	for (i = 0, g = 0; i < n; i++)
+	{
+		const uri_sort_key_t *a = &keys[perm[i]], *b = (i > 0) ? &keys[perm[i - 1]] : NULL;
+		int same_host = (b != NULL && a->host.size == b->host.size);
+
+		for (size_t d = 0; same_host && d < a->host.size; d++)
+			same_host = (sort_symbol(a, d) == sort_symbol(b, d));
+
+		if (!same_host) groups[g++] = i;
+	}
+
+	groups[g] = n;
+	return g;
+}
+
+/*
+ * Compile a list of parameter names into a filter. Returns 0 if there are
+ * more than URI_QUERY_FILTER_MAX names or one is empty or over 255 bytes.
+ * The names are referenced, not copied.
+ */
+int uri_query_filter_init(uri_query_filter_t *filter, const char * const *names, size_t n)
+{
+	if (n > URI_QUERY_FILTER_MAX) return 0;
+
+	memset(filter->first, 0, sizeof(filter->first));
+	filter->n = n;
+
+	for (size_t i = 0; i < n; i++)
+	{
+		size_t size = strlen(names[i]);
+		int prefix = (size > 0 && *(names[i] + size - 1) == '*');
+
+		if (prefix) size--;
+		if (size == 0 || size > 255) return 0;
+
+		filter->name[i] = names[i];
+		filter->size[i] = (unsigned char)size;
+		filter->prefix[i] = (unsigned char)prefix;
+		filter->first[(unsigned char)*names[i] >> 3] |= (unsigned char)(1 << (*names[i] & 7));
+	}
+
+	return 1;
+}
+
+static int query_filter_match(const uri_query_filter_t *filter, const char *key, size_t size)
+{
+	if (filter == NULL || size == 0 || !(filter->first[(unsigned char)*key >> 3] & (1 << (*key & 7)))) return 0;
+
+	for (size_t i = 0; i < filter->n; i++)
+	{
+		if ((filter->prefix[i] ? size >= filter->size[i] : size == filter->size[i]) && memcmp(key, filter->name[i], filter->size[i]) == 0) return 1;
+	}
+
+	return 0;
+}
+
+static inline size_t query_key_size(const char *c, const char *e)
+{
+	const char *k = c;
+
+	while (k < e && *k != '=' && *k != '&')
+		k++;
+
+	return k - c;
+}
+
+static int query_key_less(const char *a, size_t as, const char *b, size_t bs)
+{
+	int c = memcmp(a, b, as < bs ? as : bs);
+	return (c != 0) ? (c < 0) : (as < bs);
+}
+
+/*
+ * Write the parameter [c, end) to o with its name pct-normalized and its
+ * value as it is; the size of the name written is stored in *key.
+ */
+static size_t query_write_param(char *o, const char *c, const char *end, size_t *key)
+{
+	char *start = o;
+
+	while (c < end && *c != '=')
+	{
+		int t = next_token(&c, end, 0);
+
+		if (t & TOKEN_PCT_ENCODED) {
+			*o++ = '%';
+			*o++ = "0123456789ABCDEF"[(t >> 4) & 0xf];
+			*o++ = "0123456789ABCDEF"[t & 0xf];
+		}
+		else *o++ = (char)t;
+	}
+
+	*key = o - start;
+	memcpy(o, c, end - c);
+	return (o - start) + (end - c);
+}
+
+/*
+ * a kept parameter when sorting: its pct-normalized name at buf + at, and
+ * the raw parameter at query + offset
+ */
+typedef struct query_param_t
+{
+	size_t at;
+	size_t key;
+	size_t offset;
+	size_t size;
+} query_param_t;
+
+/*
+ * Stable bottom-up merge sort of perm[0, n) by parameter name, merging
+ * through tmp; a right-hand name is taken first only if strictly less.
+ */
+static void query_sort(const char *buf, const query_param_t *params, unsigned short *perm, unsigned short *tmp, size_t n)
+{
+	for (size_t width = 1; width < n; width *= 2)
+	{
+		for (size_t lo = 0; lo < n; lo += 2 * width)
+		{
+			size_t mid = (lo + width < n) ? lo + width : n, hi = (lo + 2 * width < n) ? lo + 2 * width : n;
+			size_t i = lo, j = mid, o = lo;
+
+			while (i < mid && j < hi)
+			{
+				const query_param_t *a = &params[perm[i]], *b = &params[perm[j]];
+				tmp[o++] = query_key_less(buf + b->at, b->key, buf + a->at, a->key) ? perm[j++] : perm[i++];
+			}
+
+			while (i < mid)
+				tmp[o++] = perm[i++];
+			while (j < hi)
+				tmp[o++] = perm[j++];
+		}
+
+		memcpy(perm, tmp, n * sizeof(*perm));
+	}
+}
+
+/*
+ * Canonicalize a query component (without its "?"): drop empty parameters
+ * and those whose name matches filter (which may be NULL), pct-normalize
+ * the names, and with URI_QUERY_SORT order the parameters by name, keeping
+ * equal names in their original order. Values are copied as they are.
+ *
+ * One pass writes the kept parameters to buf, each followed by "&". When
+ * sorting, it also records where each one is, in fixed scratch of
+ * URI_QUERY_PARAMS_MAX entries; if the names turn out not to be in order,
+ * the records are merge sorted and the result is written over buf once,
+ * straight from query. buf needs len + 1 bytes and receives a
+ * NUL-terminated result. Returns query itself if nothing would change,
+ * buf otherwise, or NULL if buf is too small or, when sorting, more than
+ * URI_QUERY_PARAMS_MAX parameters are kept; the size of the result is
+ * stored in *out_len.
+ */
+const char* uri_query_rewrite(const char *query, size_t len, const uri_query_filter_t *filter, unsigned int flags, char *buf, size_t buf_size, size_t *out_len)
+{
+	query_param_t params[URI_QUERY_PARAMS_MAX];
+	unsigned short perm[URI_QUERY_PARAMS_MAX], tmp[URI_QUERY_PARAMS_MAX];
+	const char *c = query, *e = query + len;
+	size_t w = 0, n = 0;
+	int changed = 0, sorted = 1;
+
+	if (buf_size < len + 1) return NULL;
+
+	if (len == 0) {
+		*buf = '\0';
+		*out_len = 0;
+		return query;
+	}
+
+	while (c <= e)
+	{
+		const char *end = c;
+		size_t start = w, key_size;
+
+		while (end < e && *end != '&')
+			end++;
+
+		w += query_write_param(buf + w, c, end, &key_size);
+		if (key_size != query_key_size(c, end) || memcmp(buf + start, c, key_size) != 0) changed = 1;
+
+		if (end == c || query_filter_match(filter, buf + start, key_size)) {
+			w = start;
+			changed = 1;
+		}
+		else {
+			*(buf + w++) = '&';
+
+			if (flags & URI_QUERY_SORT) {
+				if (n == URI_QUERY_PARAMS_MAX) return NULL;
+				if (n > 0 && query_key_less(buf + start, key_size, buf + params[n - 1].at, params[n - 1].key)) sorted = 0;
+
+				params[n].at = start;
+				params[n].key = key_size;
+				params[n].offset = c - query;
+				params[n].size = end - c;
+				perm[n] = (unsigned short)n;
+				n++;
+			}
+		}
+
+		c = end + 1;
+	}
+
+	if (!sorted) {
+		query_sort(buf, params, perm, tmp, n);
+
+		w = 0;
+		for (size_t i = 0; i < n; i++)
+		{
+			const query_param_t *p = &params[perm[i]];
+			size_t key_size;
+
+			w += query_write_param(buf + w, query + p->offset, query + p->offset + p->size, &key_size);
+			*(buf + w++) = '&';
+		}
+
+		changed = 1;
+	}
+
+	if (w > 0) w--;
+	*(buf + w) = '\0';
+
+	*out_len = changed ? w : len;
+	return changed ? buf : query;
+}
+
+/*
+ * Pre-parsed URI index. The image is in the byte order of the host that
+ * built it, recorded in the header as INDEX_BYTE_ORDER, with every section
+ * 8-byte aligned, so a reader on a host of the same byte order can use it
+ * in place (for example straight from mmap) and any other rejects it:
+ *
+ *   header    index_header_t
+ *   data      each URI followed by a NUL
+ *   uris      count + 1 uint64_t offsets of each URI within data
+ *   states    count bytes: URI_PARSE_DONE or URI_PARSE_ERROR
+ *   columns   one column of count uri_index_span_t per component state,
+ *             URI_HAS_SCHEME through URI_HAS_FRAGMENT
+ *
+ * Reading one column touches only that column and the URI bytes it
+ * points at.
+ */
+#define INDEX_MAGIC		"URIINDEX"
+#define INDEX_BYTE_ORDER	0x01020304u
+#define INDEX_FIRST_COLUMN	URI_HAS_SCHEME
+#define INDEX_COLUMNS		(URI_STATE_COUNT - INDEX_FIRST_COLUMN)
+
+typedef struct index_header_t
+{
+	char magic[8];
+	uint32_t byte_order;
+	uint32_t n_columns;
+	uint64_t count;
+	uint64_t data_offset;
+	uint64_t data_size;
+	uint64_t uris_offset;
+	uint64_t states_offset;
+	uint64_t columns_offset;
+} index_header_t;
+
+static inline size_t index_align(size_t n)
+{
+	return (n + 7) & ~(size_t)7;
+}
+
+static void index_layout(index_header_t *h, size_t count, size_t data_size)
+{
+	memcpy(h->magic, INDEX_MAGIC, sizeof(h->magic));
+	h->byte_order = INDEX_BYTE_ORDER;
+	h->n_columns = INDEX_COLUMNS;
+	h->count = count;
+	h->data_offset = sizeof(index_header_t);
+	h->data_size = data_size;
+	h->uris_offset = h->data_offset + index_align(data_size);
+	h->states_offset = h->uris_offset + (count + 1) * sizeof(uint64_t);
+	h->columns_offset = h->states_offset + index_align(count);
+}
+
+static size_t index_data_size(const char * const *uris, size_t n)
+{
+	size_t size = 0;
+
+	for (size_t i = 0; i < n; i++)
+		size += strlen(uris[i]) + 1;
+
+	return size;
+}
+
+static inline size_t index_image_size(const index_header_t *h)
+{
+	return h->columns_offset + (size_t)INDEX_COLUMNS * h->count * sizeof(uri_index_span_t);
+}
+
+size_t uri_index_size(const char * const *uris, size_t n)
+{
+	index_header_t h;
+
+	index_layout(&h, n, index_data_size(uris, n));
+	return index_image_size(&h);
+}
+
+/*
+ * Parse n URIs into an index image of uri_index_size() bytes at image.
+ * Returns the size of the image, or 0 if it does not fit or a URI is too
+ * long for 32-bit spans.
+ */
+size_t uri_index_build(void *image, size_t size, const char * const *uris, size_t n)
+{
+	unsigned char *base = image;
+	index_header_t h;
+	uint64_t *offsets;
+	uri_index_span_t *columns;
+	size_t at = 0;
+
+	if (((uintptr_t)image & 7) != 0) return 0;
+
+	index_layout(&h, n, index_data_size(uris, n));
+	if (size < index_image_size(&h)) return 0;
+
+	memcpy(base, &h, sizeof(h));
+	memset(base + h.data_offset + h.data_size, 0, h.uris_offset - h.data_offset - h.data_size);
+	memset(base + h.states_offset + n, 0, h.columns_offset - h.states_offset - n);
+
+	offsets = (uint64_t *)(base + h.uris_offset);
+	columns = (uri_index_span_t *)(base + h.columns_offset);
+
+	for (size_t i = 0; i < n; i++)
+	{
+		size_t len = strlen(uris[i]);
+		uri_t uri;
+		uri_state_t s = uri_init(&uri, uris[i]);
+
+		if (len >= URI_INDEX_ABSENT) return 0;
+
+		memcpy(base + h.data_offset + at, uris[i], len + 1);
+		offsets[i] = at;
+		at += len + 1;
+
+		for (size_t c = 0; c < INDEX_COLUMNS; c++)
+		{
+			columns[c * n + i].offset = URI_INDEX_ABSENT;
+			columns[c * n + i].size = 0;
+		}
+
+		while (s != URI_PARSE_DONE && s != URI_PARSE_ERROR)
+		{
+			if ((s = uri_parse_next_component(&uri)) >= INDEX_FIRST_COLUMN) {
+				columns[(s - INDEX_FIRST_COLUMN) * n + i].offset = (uint32_t)uri_get_component_offset(&uri);
+				columns[(s - INDEX_FIRST_COLUMN) * n + i].size = (uint32_t)uri_get_component_size(&uri);
+			}
+		}
+
+		*(base + h.states_offset + i) = (s == URI_PARSE_DONE && uri_get_bytes_parsed(&uri) == len) ? URI_PARSE_DONE : URI_PARSE_ERROR;
+	}
+
+	offsets[n] = at;
+	return index_image_size(&h);
+}
+
+/*
+ * Check every URI offset, state and column span of an image whose header
+ * is known good, so that readers can trust them without further checks:
+ * each URI ends in a NUL inside data, and each span lies within its URI.
+ */
+static int index_sections_valid(const unsigned char *base, const index_header_t *h)
+{
+	const char *data = (const char *)(base + h->data_offset);
+	const uint64_t *offsets = (const uint64_t *)(base + h->uris_offset);
+	const unsigned char *states = base + h->states_offset;
+	const uri_index_span_t *columns = (const uri_index_span_t *)(base + h->columns_offset);
+	size_t n = (size_t)h->count;
+
+	if (offsets[0] != 0 || offsets[n] != h->data_size) return 0;
+
+	for (size_t i = 0; i < n; i++)
+	{
+		uint64_t start = offsets[i], end = offsets[i + 1];
+
+		if (end <= start || end > h->data_size || *(data + end - 1) != '\0') return 0;
+		if (states[i] != URI_PARSE_DONE && states[i] != URI_PARSE_ERROR) return 0;
+
+		for (size_t c = 0; c < INDEX_COLUMNS; c++)
+		{
+			const uri_index_span_t *span = &columns[c * n + i];
+
+			if (span->offset == URI_INDEX_ABSENT) continue;
+			if ((uint64_t)span->offset + span->size > end - start - 1) return 0;
+		}
+	}
+
+	return 1;
+}
+
+/*
+ * Check an index image and point the reader at its sections: the header
+ * must match the layout of its count and data size, and every offset and
+ * span must lie inside the image, so an image from an untrusted source is
+ * safe to read. The check is linear in the size of the image. Nothing is
+ * copied; image must stay mapped while in use.
+ * Returns 1 on success, 0 if the image is not a usable index.
+ */
+int uri_index_open(uri_index_t *index, const void *image, size_t size)
+{
+	const unsigned char *base = image;
+	index_header_t h, expect;
+
+	if (((uintptr_t)image & 7) != 0 || size < sizeof(h)) return 0;
+
+	memcpy(&h, base, sizeof(h));
+	if (memcmp(h.magic, INDEX_MAGIC, sizeof(h.magic)) != 0 || h.byte_order != INDEX_BYTE_ORDER || h.n_columns != INDEX_COLUMNS) return 0;
+	if (h.count > size || h.data_size > size) return 0;
+
+	index_layout(&expect, (size_t)h.count, (size_t)h.data_size);
+	if (memcmp(&h, &expect, sizeof(h)) != 0) return 0;
+	if (index_image_size(&expect) > size) return 0;
+	if (!index_sections_valid(base, &h)) return 0;
+
+	index->base = base;
+	index->count = (size_t)h.count;
+	index->data = (const char *)(base + h.data_offset);
+	index->data_size = (size_t)h.data_size;
+	index->uris = (const uint64_t *)(base + h.uris_offset);
+	index->states = base + h.states_offset;
+	index->columns = (const uri_index_span_t *)(base + h.columns_offset);
+
+	return 1;
+}
+
+size_t uri_index_count(const uri_index_t *index)
+{
+	return index->count;
+}
+
+/*
+ * The i-th URI as a NUL-terminated string inside the image, ready for
+ * uri_init(); its length is stored in *len if len is not NULL.
+ */
+const char* uri_index_uri(const uri_index_t *index, size_t i, size_t *len)
+{
+	uint64_t start = index->uris[i], end = index->uris[i + 1];
+
+	if (len != NULL) *len = (size_t)(end - start - 1);
+	return index->data + start;
+}
+
+uri_state_t uri_index_state(const uri_index_t *index, size_t i)
+{
+	return (uri_state_t)*(index->states + i);
+}
+
+/*
+ * The column of spans for one component state, count entries long.
+ */
+const uri_index_span_t* uri_index_column(const uri_index_t *index, uri_state_t component)
+{
+	if (component < INDEX_FIRST_COLUMN || (int)component >= URI_STATE_COUNT) return NULL;
+	return index->columns + (size_t)(component - INDEX_FIRST_COLUMN) * index->count;
+}
+
+/*
+ * RFC 6570 URI templates, levels 1 to 4 with string values. A template
+ * is compiled once into literal and variable instructions; a variable
+ * instruction holds the index of its operator in template_rules (those
+ * before TEMPLATE_SIMPLE are literals), the index of its variable and its
+ * prefix length. Values are
+ * bound by variable index, in order of first appearance in the template.
+ * Explode modifiers are accepted and have no effect on string values.
+ */
+
+/* operator, first, sep, named, ifemp, allow reserved (RFC 6570 Appendix A) */
+#define TEMPLATE_OPERATOR_MAP(F)		\
+	F('\0', '\0', ',', 0, 0, 0)		\
+	F('+',  '\0', ',', 0, 0, 1)		\
+	F('#',  '#',  ',', 0, 0, 1)		\
+	F('.',  '.',  '.', 0, 0, 0)		\
+	F('/',  '/',  '/', 0, 0, 0)		\
+	F(';',  ';',  ';', 1, 0, 0)		\
+	F('?',  '?',  '&', 1, 1, 0)		\
+	F('&',  '&',  '&', 1, 1, 0)
+
+/* a literal copied as it is, or one with non-ASCII bytes to pct-encode */
+#define TEMPLATE_LITERAL		0
+#define TEMPLATE_LITERAL_ENCODED	1
+#define TEMPLATE_SIMPLE			2
+
+static const struct template_rule
+{
+	char operator;
+	char first;
+	char sep;
+	unsigned char named;
+	unsigned char ifemp;
+	unsigned char reserved;
+} template_rules[] = {
+	{ 0, 0, 0, 0, 0, 0 },
+	{ 0, 0, 0, 0, 0, 0 },
+#define F(operator, first, sep, named, ifemp, reserved) { operator, first, sep, named, ifemp, reserved },
+	TEMPLATE_OPERATOR_MAP(F)
+#undef F
+};
+
+static const char template_hex[] = "0123456789ABCDEF";
+
+/*
+ * literals (RFC 6570 2.1) are unreserved / reserved but "'" / pct-encoded
+ * / ucschar / iprivate; each byte of a non-ASCII character, counted in
+ * *ucs, is pct-encoded on expansion
+ */
+static inline const char* template_literal(const char *c, size_t *ucs)
+{
+	*ucs = 0;
+
+	while (*c != '{' && *c != '}')
+	{
+		if ((ascii_flags[(unsigned char)*c] & (UNRESERVED | GEN_DELIM | SUB_DELIM)) && *c != '\'') c++;
+		else if ((unsigned char)*c >= 0x80) {
+			c++;
+			(*ucs)++;
+		}
+		else if (scout_pct_encoded(c) != NULL) c += 3;
+		else break;
+	}
+
+	return c;
+}
+
+/*
+ * varname = varchar *( ["."] varchar ), varchar = ALPHA / DIGIT / "_" / pct-encoded
+ */
+static inline const char* template_varname(const char *c)
+{
+	const char *p = c;
+
+	for (;;)
+	{
+		if ((ascii_flags[(unsigned char)*c] & (ALPHA | DIGIT)) || *c == '_') c++;
+		else if (scout_pct_encoded(c) != NULL) c += 3;
+		else if (*c == '.' && c > p && *(c - 1) != '.') c++;
+		else break;
+	}
+
+	return (c > p && *(c - 1) == '.') ? c - 1 : c;
+}
+
+static int template_push(uri_template_t *tpl, unsigned char rule, const char *start, const char *end)
+{
+	uri_template_op_t *op;
+
+	if (tpl->n == URI_TEMPLATE_MAX) return 0;
+
+	op = &tpl->op[tpl->n++];
+	op->rule = rule;
+	op->first = 0;
+	op->prefix = 0;
+	op->var = 0;
+	op->span.offset = start - tpl->text;
+	op->span.size = end - start;
+
+	if (rule < TEMPLATE_SIMPLE) tpl->size += end - start;
+	else tpl->size += 1 + (template_rules[rule].named ? (end - start) + 1 : 0);
+
+	return 1;
+}
+
+static int template_bind(uri_template_t *tpl, uri_template_op_t *op)
+{
+	const char *name = tpl->text + op->span.offset;
+
+	for (op->var = 0; op->var < tpl->vars; op->var++)
+	{
+		const uri_span_t *var = &tpl->var[op->var];
+		if (var->size == op->span.size && memcmp(tpl->text + var->offset, name, var->size) == 0) return 1;
+	}
+
+	if (tpl->vars == URI_TEMPLATE_MAX) return 0;
+
+	tpl->var[tpl->vars++] = op->span;
+	return 1;
+}
+
+/*
+ * Compile the NUL-terminated template text into tpl. text is referenced,
+ * not copied, and must outlive tpl. Returns URI_PARSE_DONE, or
+ * URI_PARSE_ERROR with the offset of the first byte not accepted; a
+ * template of more than URI_TEMPLATE_MAX instructions or variables is an
+ * error at the expression that overflows.
+ */
+uri_state_t uri_template_compile(uri_template_t *tpl, const char *text, size_t *err_off)
+{
+	const char *c = text, *p;
+
+	tpl->text = text;
+	tpl->size = 0;
+	tpl->n = 0;
+	tpl->vars = 0;
+
+	while (*c != '\0')
+	{
+		unsigned char rule = TEMPLATE_SIMPLE;
+		int first = 1;
+		size_t ucs;
+
+		if (*c != '{') {
+			if ((p = template_literal(c, &ucs)) == c || !template_push(tpl, ucs ? TEMPLATE_LITERAL_ENCODED : TEMPLATE_LITERAL, c, p)) goto error;
+			tpl->size += 2 * ucs;
+			c = p;
+			continue;
+		}
+
+		for (unsigned char i = TEMPLATE_SIMPLE + 1; i < sizeof(template_rules)/sizeof(template_rules[0]); i++)
+		{
+			if (*(c + 1) == template_rules[i].operator) rule = i;
+		}
+
+		c += (rule == TEMPLATE_SIMPLE) ? 1 : 2;
+
+		do {
+			uri_template_op_t *op;
+
+			if (!first) c++;
+			if ((p = template_varname(c)) == c || !template_push(tpl, rule, c, p)) goto error;
+
+			op = &tpl->op[tpl->n - 1];
+			op->first = first;
+			if (!template_bind(tpl, op)) goto error;
+			c = p;
+
+			if (*c == ':') {
+				unsigned int prefix = 0;
+
+				for (p = ++c; (ascii_flags[(unsigned char)*c] & DIGIT) && c - p < 4; c++)
+					prefix = prefix * 10 + (*c - '0');
+
+				if (*p == '0' || prefix == 0) {
+					c = p;
+					goto error;
+				}
+				op->prefix = (unsigned short)prefix;
+			}
+			else if (*c == '*') c++;
+
+			first = 0;
+		} while (*c == ',');
+
+		if (*c != '}') goto error;
+		c++;
+	}
+
+	if (err_off != NULL) *err_off = c - text;
+	return URI_PARSE_DONE;
+
+error:
+
+	if (err_off != NULL) *err_off = c - text;
+	return URI_PARSE_ERROR;
+}
+
+size_t uri_template_vars(const uri_template_t *tpl)
+{
+	return tpl->vars;
+}
+
+const char* uri_template_var(const uri_template_t *tpl, size_t i, size_t *len)
+{
+	if (len != NULL) *len = tpl->var[i].size;
+	return tpl->text + tpl->var[i].offset;
+}
+
+/*
+ * the bytes of value that a prefix of max characters keeps; UTF-8
+ * continuation bytes do not count as characters
+ */
+static inline size_t template_prefix(const char *value, size_t n, unsigned int max)
+{
+	size_t i = 0;
+
+	for (unsigned int chars = 0; i < n; i++)
+	{
+		if (((unsigned char)*(value + i) & 0xc0) != 0x80 && chars++ == max) break;
+	}
+
+	return i;
+}
+
+/*
+ * The size of an expansion, without its NUL, is at most what the
+ * instructions themselves produce (tpl->size, counted at compile time)
+ * plus each value used, pct-encoded throughout.
+ */
+size_t uri_template_expand_size(const uri_template_t *tpl, const char * const *values)
+{
+	size_t size = tpl->size;
+
+	for (size_t i = 0; i < tpl->n; i++)
+	{
+		const uri_template_op_t *op = &tpl->op[i];
+		const char *value;
+
+		if (op->rule < TEMPLATE_SIMPLE || (value = values[op->var]) == NULL) continue;
+
+		size += 3 * strlen(value);
+	}
+
+	return size;
+}
+
+static inline char* template_encode(char *o, const char *c, const char *e, int reserved)
+{
+	unsigned char mask = reserved ? (UNRESERVED | GEN_DELIM | SUB_DELIM) : UNRESERVED;
+
+	while (c < e)
+	{
+		if (ascii_flags[(unsigned char)*c] & mask) *o++ = *c++;
+		else if (reserved && e - c >= 3 && scout_pct_encoded(c) != NULL) {
+			memcpy(o, c, 3);
+			o += 3;
+			c += 3;
+		}
+		else {
+			*o++ = '%';
+			*o++ = template_hex[(unsigned char)*c >> 4];
+			*o++ = template_hex[(unsigned char)*c++ & 0x0f];
+		}
+	}
+
+	return o;
+}
+
+/*
+ * Expand tpl with values[i] bound to variable i (NULL for undefined) into
+ * out, which must hold uri_template_expand_size() + 1 bytes. The result
+ * is NUL-terminated and its length returned.
+ */
+size_t uri_template_expand(const uri_template_t *tpl, const char * const *values, char *out)
+{
+	char *o = out;
+	int defined = 0;
+
+	for (size_t i = 0; i < tpl->n; i++)
+	{
+		const uri_template_op_t *op = &tpl->op[i];
+		const struct template_rule *rule = &template_rules[op->rule];
+		const char *value;
+		size_t n;
+
+		if (op->rule == TEMPLATE_LITERAL_ENCODED) {
+			o = template_encode(o, tpl->text + op->span.offset, tpl->text + op->span.offset + op->span.size, 1);
+			continue;
+		}
+		else if (op->rule == TEMPLATE_LITERAL) {
+			memcpy(o, tpl->text + op->span.offset, op->span.size);
+			o += op->span.size;
+			continue;
+		}
+
+		if (op->first) defined = 0;
+		if ((value = values[op->var]) == NULL) continue;
+
+		if (defined) *o++ = rule->sep;
+		else if (rule->first != '\0') *o++ = rule->first;
+		defined = 1;
+
+		n = strlen(value);
+		if (op->prefix != 0) n = template_prefix(value, n, op->prefix);
+
+		if (rule->named) {
+			memcpy(o, tpl->text + op->span.offset, op->span.size);
+			o += op->span.size;
+			if (n != 0 || rule->ifemp) *o++ = '=';
+		}
+
+		o = template_encode(o, value, value + n, rule->reserved);
+	}
+
+	*o = '\0';
+	return o - out;
+}
+
+/*
+ * Expand tpl once per row of bindings: row i is values[i * vars] onward,
+ * vars being uri_template_vars(). The expansions are written one after
+ * another into out, each NUL-terminated, with row i at offsets[i] and
+ * offsets[rows] just past the last. Stops at the first row that might
+ * not fit in size bytes; returns the number of rows expanded.
+ */
+size_t uri_template_expand_batch(const uri_template_t *tpl, const char * const *values, size_t n, char *out, size_t size, size_t *offsets)
+{
+	size_t i, pos = 0;
+
+	for (i = 0; i < n; i++)
+	{
+		const char * const *row = values + i * tpl->vars;
+
+		if (uri_template_expand_size(tpl, row) >= size - pos) break;
+
+		offsets[i] = pos;
+		pos += uri_template_expand(tpl, row, out + pos) + 1;
+	}
+
+	offsets[i] = pos;
+	return i;
+}
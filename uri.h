@@ -1,6 +1,9 @@
 #ifndef URI_H_INCLUDED
 #define URI_H_INCLUDED
 
+#include <stddef.h>
+#include <stdint.h>
+
 #ifdef __GNUC__
 #define __pure __attribute__((pure))
 #else
@@ -28,6 +31,28 @@ typedef enum
 #undef F
 } uri_state_t;
 
+/* request-target forms, RFC 9112 3.2 */
+#define URI_TARGET_FORM_MAP(F)			\
+	F(0,	ORIGIN,		origin-form)	\
+	F(1,	ABSOLUTE,	absolute-form)	\
+	F(2,	AUTHORITY,	authority-form)	\
+	F(3,	ASTERISK,	asterisk-form)	\
+
+typedef enum
+{
+#define F(id, symbol, _) URI_TARGET_##symbol = id,
+	URI_TARGET_FORM_MAP(F)
+#undef F
+} uri_target_form_t;
+
+enum
+{
+	URI_STATE_COUNT = 0
+#define F(id, symbol, _) + 1
+	URI_STATE_MAP(F)
+#undef F
+};
+
 typedef struct uri_t
 {
 	const char *data;
@@ -36,14 +61,164 @@ typedef struct uri_t
 	uri_state_t state;
 } uri_t;
 
+typedef struct uri_span_t
+{
+	size_t offset;
+	size_t size;
+} uri_span_t;
+
+/*
+ * the components of a request-target, indexed by state; bit (1 << state)
+ * of components is set for each one present
+ */
+#define URI_TARGET_CONNECT 0x01
+
+typedef struct uri_target_t
+{
+	uri_target_form_t form;
+	unsigned int components;
+	uri_span_t component[URI_STATE_COUNT];
+} uri_target_t;
+
+/*
+ * a data: URI as spans of the URI; parameters runs from the first ";" up
+ * to ";base64" or ",", and size is the decoded size of the payload
+ */
+typedef struct uri_data_t
+{
+	uri_span_t mediatype;
+	uri_span_t parameters;
+	uri_span_t data;
+	int base64;
+	size_t size;
+} uri_data_t;
+
+typedef struct uri_sort_key_t
+{
+	const char *data;
+	uri_span_t host;
+	uri_span_t path;
+} uri_sort_key_t;
+
+/*
+ * one entry of a component column in a URI index; offset is relative to
+ * the start of the URI and is URI_INDEX_ABSENT if there is no component
+ */
+#define URI_INDEX_ABSENT 0xffffffffu
+
+typedef struct uri_index_span_t
+{
+	uint32_t offset;
+	uint32_t size;
+} uri_index_span_t;
+
+/*
+ * parameter names removed by uri_query_rewrite(); a name ending in "*"
+ * matches every name with that prefix
+ */
+#define URI_QUERY_FILTER_MAX 64
+
+typedef struct uri_query_filter_t
+{
+	const char *name[URI_QUERY_FILTER_MAX];
+	unsigned char size[URI_QUERY_FILTER_MAX];
+	unsigned char prefix[URI_QUERY_FILTER_MAX];
+	unsigned char first[32];
+	size_t n;
+} uri_query_filter_t;
+
+#define URI_QUERY_SORT 0x01
+
+/*
+ * the most parameters uri_query_rewrite() keeps when sorting
+ */
+#define URI_QUERY_PARAMS_MAX 256
+
+/*
+ * a compiled RFC 6570 URI template; spans are into text, and var holds
+ * the distinct variable names in order of first appearance. first marks
+ * the first variable of an expression and is 0 for literals.
+ */
+#define URI_TEMPLATE_MAX 64
+
+typedef struct uri_template_op_t
+{
+	uri_span_t span;
+	unsigned short var;
+	unsigned short prefix;
+	unsigned char rule;
+	unsigned char first;
+} uri_template_op_t;
+
+typedef struct uri_template_t
+{
+	const char *text;
+	size_t size;
+	size_t n;
+	size_t vars;
+	uri_template_op_t op[URI_TEMPLATE_MAX];
+	uri_span_t var[URI_TEMPLATE_MAX];
+} uri_template_t;
+
+typedef struct uri_index_t
+{
+	const unsigned char *base;
+	size_t count;
+	const char *data;
+	size_t data_size;
+	const uint64_t *uris;
+	const unsigned char *states;
+	const uri_index_span_t *columns;
+} uri_index_t;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 uri_state_t uri_init(uri_t *, const char *);
 uri_state_t uri_init_with_state(uri_t *, const char *, uri_state_t);
 
 size_t uri_get_bytes_parsed(const uri_t *);
 const char* uri_get_component_pointer(const uri_t *);
+size_t uri_get_component_offset(const uri_t *);
 size_t uri_get_component_size(const uri_t *);
 uri_state_t uri_get_state(const uri_t *);
 
 uri_state_t uri_parse_next_component(uri_t *);
 
+uri_state_t uri_validate(const char *, size_t, size_t *);
+
+uri_state_t uri_parse_request_target(uri_target_t *, const char *, size_t, unsigned int, size_t *);
+
+uri_state_t uri_parse_data(uri_data_t *, const char *, size_t, size_t *);
+uri_state_t uri_data_decode(const uri_data_t *, const char *, size_t *, char *, size_t, size_t *);
+
+int uri_equivalent(const char *, const char *);
+
+uri_state_t uri_init_sort_key(uri_sort_key_t *, const char *);
+size_t uri_sort_scratch_size(size_t);
+size_t uri_sort_by_host(const uri_sort_key_t *, size_t, size_t *, size_t *, void *);
+
+int uri_query_filter_init(uri_query_filter_t *, const char * const *, size_t);
+const char* uri_query_rewrite(const char *, size_t, const uri_query_filter_t *, unsigned int, char *, size_t, size_t *);
+
+size_t uri_index_size(const char * const *, size_t);
+size_t uri_index_build(void *, size_t, const char * const *, size_t);
+int uri_index_open(uri_index_t *, const void *, size_t);
+size_t uri_index_count(const uri_index_t *);
+const char* uri_index_uri(const uri_index_t *, size_t, size_t *);
+uri_state_t uri_index_state(const uri_index_t *, size_t);
+const uri_index_span_t* uri_index_column(const uri_index_t *, uri_state_t);
+
+uri_state_t uri_template_compile(uri_template_t *, const char *, size_t *);
+size_t uri_template_vars(const uri_template_t *);
+const char* uri_template_var(const uri_template_t *, size_t, size_t *);
+size_t uri_template_expand_size(const uri_template_t *, const char * const *);
+size_t uri_template_expand(const uri_template_t *, const char * const *, char *);
+size_t uri_template_expand_batch(const uri_template_t *, const char * const *, size_t, char *, size_t, size_t *);
+
+#ifdef __cplusplus
+}
+#endif
+
 #endif
@@ -0,0 +1,647 @@
+#ifndef URI_HPP_INCLUDED
+#define URI_HPP_INCLUDED
+
+#include <array>
+#include <cstddef>
+#include <iterator>
+#include <stdexcept>
+#include <string_view>
+
+#include "uri.h"
+
+namespace uri {
+
+enum class state : int
+{
+#define F(id, symbol, _) symbol = id,
+	URI_STATE_MAP(F)
+#undef F
+};
+
+struct component
+{
+	state kind = state::PARSE_DONE;
+	std::string_view value{};
+};
+
+/*
+ * Every component of a parsed URI, in order. There is at most one of
+ * each of scheme, userinfo, host, port, path, query and fragment.
+ */
+class parsed
+{
+public:
+	constexpr bool valid() const { return valid_; }
+	constexpr std::size_t bytes_parsed() const { return bytes_parsed_; }
+
+	constexpr std::size_t size() const { return count_; }
+	constexpr const component* begin() const { return parts_.data(); }
+	constexpr const component* end() const { return parts_.data() + count_; }
+
+	constexpr bool has(state kind) const
+	{
+		for (std::size_t i = 0; i < count_; i++)
+			if (parts_[i].kind == kind) return true;
+
+		return false;
+	}
+
+	constexpr std::string_view get(state kind) const
+	{
+		for (std::size_t i = 0; i < count_; i++)
+			if (parts_[i].kind == kind) return parts_[i].value;
+
+		return std::string_view();
+	}
+
+	constexpr std::string_view scheme() const { return get(state::HAS_SCHEME); }
+	constexpr std::string_view userinfo() const { return get(state::HAS_USERINFO); }
+	constexpr std::string_view host() const { return get(state::HAS_HOST); }
+	constexpr std::string_view port() const { return get(state::HAS_PORT); }
+	constexpr std::string_view path() const { return has(state::HAS_PATH) ? get(state::HAS_PATH) : get(state::HAS_EMPTY_PATH); }
+	constexpr std::string_view query() const { return get(state::HAS_QUERY); }
+	constexpr std::string_view fragment() const { return get(state::HAS_FRAGMENT); }
+
+	constexpr void push(state kind, std::string_view value)
+	{
+		if (count_ < parts_.size()) parts_[count_++] = component{kind, value};
+	}
+
+	constexpr void finish(state final_state, std::size_t bytes_parsed, std::size_t size)
+	{
+		bytes_parsed_ = bytes_parsed;
+		valid_ = (final_state == state::PARSE_DONE && bytes_parsed == size);
+	}
+
+private:
+	std::array<component, 7> parts_{};
+	std::size_t count_ = 0;
+	std::size_t bytes_parsed_ = 0;
+	bool valid_ = false;
+};
+
+namespace detail {
+
+/*
+ * A constexpr transcription of the scout_* productions and proceed() in
+ * uri.c. Positions are indices into the input and "none" plays the part
+ * of NULL. Reads past the end of the view see a NUL, just like the C
+ * engine sees the terminator.
+ */
+constexpr long none = -1;
+
+constexpr char at(std::string_view s, long i)
+{
+	return (i >= 0 && static_cast<std::size_t>(i) < s.size()) ? s[static_cast<std::size_t>(i)] : '\0';
+}
+
+constexpr bool is_alpha(char c) { return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z'); }
+constexpr bool is_digit(char c) { return c >= '0' && c <= '9'; }
+constexpr bool is_hex(char c) { return is_digit(c) || (c >= 'a' && c <= 'f') || (c >= 'A' && c <= 'F'); }
+
+constexpr bool is_sub_delim(char c)
+{
+	switch (c)
+	{
+	case '!': case '$': case '&': case '\'': case '(': case ')':
+	case '*': case '+': case ',': case ';': case '=':
+		return true;
+	default:
+		return false;
+	}
+}
+
+constexpr bool is_unreserved(char c) { return is_alpha(c) || is_digit(c) || c == '-' || c == '.' || c == '_' || c == '~'; }
+constexpr bool is_pchar(char c) { return is_unreserved(c) || is_sub_delim(c) || c == ':' || c == '@'; }
+
+constexpr long scout_dec_octet(std::string_view s, long c)
+{
+	if (!is_digit(at(s, c))) return none;
+	if (at(s, c) == '0' || !is_digit(at(s, c + 1))) return c;
+	if (!is_digit(at(s, c + 2))) return c + 1;
+
+	switch (at(s, c))
+	{
+	case '1':
+		return c + 2;
+	case '2':
+		return (at(s, c + 1) < '5' || (at(s, c + 1) == '5' && at(s, c + 2) <= '5')) ? c + 2 : c + 1;
+	default:
+		return c + 1;
+	}
+}
+
+constexpr long scout_ipv4address(std::string_view s, long c)
+{
+	for (int i = 0; i < 3; i++)
+	{
+		if ((c = scout_dec_octet(s, c)) == none) return none;
+		if (at(s, ++c) != '.') return none;
+		c++;
+	}
+
+	return scout_dec_octet(s, c);
+}
+
+constexpr long scout_h16(std::string_view s, long c)
+{
+	long p = none, c0 = c;
+
+	while (is_hex(at(s, c)))
+		p = c++;
+
+	return (p == none || p - c0 < 4) ? p : none;
+}
+
+constexpr long scout_ls32(std::string_view s, long c)
+{
+	long p = scout_ipv4address(s, c);
+
+	if (p == none) {
+		if ((p = scout_h16(s, c)) == none || at(s, p + 1) != ':') return none;
+		return scout_h16(s, p + 2);
+	}
+
+	return p;
+}
+
+/*
+ * N( h16 ":" ) ls32
+ */
+constexpr long scout_ipv6address_rh(std::string_view s, long c, int n)
+{
+	if ((c = scout_h16(s, c)) == none) return none;
+	if (at(s, c + 1) != ':') return none;
+	return (n == 1) ? scout_ls32(s, c + 2) : scout_ipv6address_rh(s, c + 2, n - 1);
+}
+
+constexpr long scout_ipv6address(std::string_view s, long c)
+{
+	long p = scout_ipv6address_rh(s, c, 6);
+	int left_hand_count = 0;
+
+	if (p != none) return p;
+
+	p = c - 1;
+	c = scout_h16(s, c);
+	while (c != none)
+	{
+		p = c++;
+		left_hand_count++;
+		c = (at(s, c) == ':') ? scout_h16(s, c + 1) : none;
+	}
+
+	if (at(s, p + 1) != ':' || at(s, p + 2) != ':') return none;
+	p += 3;
+
+	for (int k = left_hand_count; k <= 7; k++)
+	{
+		if (k <= 4) c = scout_ipv6address_rh(s, p, 5 - k);
+		else if (k == 5) c = scout_ls32(s, p);
+		else if (k == 6) c = scout_h16(s, p);
+		else return p - 1;
+
+		if (c != none) return c;
+	}
+
+	return none;
+}
+
+constexpr long scout_ipvfuture(std::string_view s, long c)
+{
+	long p = none;
+
+	if ((at(s, c) == 'v' || at(s, c) == 'V') && is_hex(at(s, c + 1))) {
+		c++;
+		while (is_hex(at(s, c)))
+			c++;
+
+		if (at(s, c) == '.') {
+			c++;
+			while (is_unreserved(at(s, c)) || is_sub_delim(at(s, c)) || at(s, c) == ':')
+				p = c++;
+		}
+	}
+
+	return p;
+}
+
+constexpr long scout_ip_literal(std::string_view s, long c)
+{
+	if (at(s, c) != '[') return none;
+
+	long p = scout_ipv6address(s, c + 1);
+	if (p != none && at(s, p + 1) == ']') return p + 1;
+	if ((p = scout_ipvfuture(s, c + 1)) != none && at(s, p + 1) == ']') return p + 1;
+	return none;
+}
+
+constexpr long scout_pct_encoded(std::string_view s, long c)
+{
+	return (at(s, c) == '%' && is_hex(at(s, c + 1)) && is_hex(at(s, c + 2))) ? c + 2 : none;
+}
+
+constexpr long scout_pchar(std::string_view s, long c)
+{
+	return is_pchar(at(s, c)) ? c : scout_pct_encoded(s, c);
+}
+
+constexpr long scout_query(std::string_view s, long c)
+{
+	long p = none;
+
+	do
+	{
+		if (at(s, c) == '/' || at(s, c) == '?') p = c++;
+		else if ((c = scout_pchar(s, c)) != none) p = c++;
+	} while (c != none);
+
+	return p;
+}
+
+constexpr long scout_any_segment(std::string_view s, long c, char exclude)
+{
+	long p = none;
+
+	c = scout_pchar(s, c);
+	while (c != none && at(s, c) != exclude)
+	{
+		p = c++;
+		c = scout_pchar(s, c);
+	}
+
+	return p;
+}
+
+constexpr long scout_reg_name(std::string_view s, long c)
+{
+	long p = none;
+
+	do
+	{
+		if (is_unreserved(at(s, c)) || is_sub_delim(at(s, c))) p = c++;
+		else if ((c = scout_pct_encoded(s, c)) != none) p = c++;
+	} while (c != none);
+
+	return p;
+}
+
+constexpr long scout_path_abempty(std::string_view s, long c)
+{
+	long p = none;
+
+	while (at(s, c) == '/')
+	{
+		p = c++;
+		long g = scout_any_segment(s, c, '\0');
+		if (g != none) {
+			p = g;
+			c = g + 1;
+		}
+	}
+
+	return p;
+}
+
+constexpr long scout_path_after_segment(std::string_view s, long p)
+{
+	long c = p + 1;
+
+	while ((c = scout_path_abempty(s, c)) != none)
+		p = c++;
+
+	return p;
+}
+
+constexpr long scout_path_rootless(std::string_view s, long c)
+{
+	long p = scout_any_segment(s, c, '\0');
+	return (p == none) ? none : scout_path_after_segment(s, p);
+}
+
+constexpr long scout_path_noscheme(std::string_view s, long c)
+{
+	long p = scout_any_segment(s, c, ':');
+	return (p == none) ? none : scout_path_after_segment(s, p);
+}
+
+constexpr long scout_path_absolute(std::string_view s, long c)
+{
+	long p = scout_path_rootless(s, c + 1);
+	return (p == none) ? c : p;
+}
+
+constexpr long scout_userinfo(std::string_view s, long c)
+{
+	long p = c - 1;
+
+	for (;;)
+	{
+		char ch = at(s, c);
+
+		if (is_unreserved(ch) || is_sub_delim(ch) || ch == ':') p = c++;
+		else if (scout_pct_encoded(s, c) != none) {
+			p = c + 2;
+			c += 3;
+		}
+		else if (ch == '@') return p;
+		else return none;
+	}
+}
+
+constexpr long scout_host(std::string_view s, long c)
+{
+	long p = scout_reg_name(s, c);
+
+	if (p == none && (p = scout_ipv4address(s, c)) == none)
+		return scout_ip_literal(s, c);
+
+	return p;
+}
+
+constexpr long scout_port(std::string_view s, long c)
+{
+	long p = none;
+
+	while (is_digit(at(s, c)))
+		p = c++;
+
+	return p;
+}
+
+constexpr long scout_scheme(std::string_view s, long c)
+{
+	long p = none;
+
+	if (!is_alpha(at(s, c))) return none;
+
+	p = c++;
+	while (is_alpha(at(s, c)) || is_digit(at(s, c)) || at(s, c) == '+' || at(s, c) == '-' || at(s, c) == '.')
+		p = c++;
+
+	return p;
+}
+
+/*
+ * The labels of proceed() become the functions below.
+ */
+constexpr state proceed_path_abempty(std::string_view s, long &start, long &end)
+{
+	if ((end = scout_path_abempty(s, start)) != none) {
+		end++;
+		return state::HAS_PATH;
+	}
+
+	end = start;
+	return state::HAS_EMPTY_PATH;
+}
+
+constexpr state proceed_port(std::string_view s, long &start, long &end)
+{
+	if (at(s, start) == ':' && (end = scout_port(s, start + 1)) != none) {
+		start++;
+		end++;
+		return state::HAS_PORT;
+	}
+
+	return proceed_path_abempty(s, start, end);
+}
+
+constexpr state proceed_host(std::string_view s, long &start, long &end)
+{
+	if ((end = scout_host(s, start)) != none) {
+		end++;
+		return state::HAS_HOST;
+	}
+
+	return proceed_port(s, start, end);
+}
+
+constexpr state proceed_fragment(std::string_view s, long &start, long &end)
+{
+	start++;
+	if ((end = scout_query(s, start)) != none) end++;
+	else end = start;
+
+	return state::HAS_FRAGMENT;
+}
+
+constexpr state proceed_relative_ref(std::string_view s, long &start, long &end, bool relative_ref)
+{
+	if (at(s, start) == '/') {
+		if (at(s, start + 1) == '/') {
+			start += 2;
+			if ((end = scout_userinfo(s, start)) != none) {
+				end++;
+				return state::HAS_USERINFO;
+			}
+
+			return proceed_host(s, start, end);
+		}
+
+		end = scout_path_absolute(s, start) + 1;
+		return state::HAS_PATH;
+	}
+
+	if (relative_ref && (end = scout_path_noscheme(s, start)) != none) {
+		end++;
+		return state::HAS_PATH;
+	}
+	else if ((end = scout_path_rootless(s, start)) != none) {
+		end++;
+		return state::HAS_PATH;
+	}
+	else if (scout_pchar(s, start) == none) {
+		end = start;
+		return state::HAS_EMPTY_PATH;
+	}
+
+	return state::PARSE_ERROR;
+}
+
+constexpr state proceed(std::string_view s, long &start, long &end, state in_state)
+{
+	switch (in_state)
+	{
+	case state::PARSE_DONE:
+		start = end;
+		return state::PARSE_DONE;
+
+	case state::PARSE_RESET:
+		if ((end = scout_scheme(s, start)) != none && at(s, end + 1) == ':') {
+			end++;
+			return state::HAS_SCHEME;
+		}
+
+		end = start;
+		return proceed_relative_ref(s, start, end, true);
+
+	case state::HAS_SCHEME:
+		if (at(s, end) != ':') return state::PARSE_ERROR;
+		start = ++end;
+		return proceed_relative_ref(s, start, end, false);
+
+	case state::HAS_USERINFO:
+		if (at(s, end) != '@') return state::PARSE_ERROR;
+		start = ++end;
+		return proceed_host(s, start, end);
+
+	case state::HAS_HOST:
+		start = end;
+		return proceed_port(s, start, end);
+
+	case state::HAS_PORT:
+		start = end;
+		return proceed_path_abempty(s, start, end);
+
+	case state::HAS_PATH:
+	case state::HAS_EMPTY_PATH:
+		start = end;
+		if (at(s, start) == '?') {
+			start++;
+			if ((end = scout_query(s, start)) != none) end++;
+			else end = start;
+
+			return state::HAS_QUERY;
+		}
+		else if (at(s, start) == '#') return proceed_fragment(s, start, end);
+
+		end = start;
+		return state::PARSE_DONE;
+
+	case state::HAS_QUERY:
+		start = end;
+		if (at(s, start) == '#') return proceed_fragment(s, start, end);
+
+		end = start;
+		return state::PARSE_DONE;
+
+	case state::HAS_FRAGMENT:
+		start = end;
+		return state::PARSE_DONE;
+
+	default:
+		return state::PARSE_ERROR;
+	}
+}
+
+constexpr parsed parse_constexpr(std::string_view s)
+{
+	parsed result;
+	long start = 0, end = 0;
+	state st = state::PARSE_RESET;
+
+	while ((st = proceed(s, start, end, st)) != state::PARSE_DONE && st != state::PARSE_ERROR)
+		result.push(st, s.substr(static_cast<std::size_t>(start), static_cast<std::size_t>(end - start)));
+
+	result.finish(st, (st == state::PARSE_DONE) ? static_cast<std::size_t>(end) : 0, s.size());
+	return result;
+}
+
+} /* namespace detail */
+
+#if defined(__cpp_consteval)
+#define URI_CONSTEVAL consteval
+#else
+#define URI_CONSTEVAL constexpr
+#endif
+
+/*
+ * Lazily walks the components of a URI. Like parse(), it reads only the
+ * bytes of the view and yields views into it, so s must outlive the walk.
+ */
+class components
+{
+public:
+	class iterator
+	{
+	public:
+		using iterator_category = std::input_iterator_tag;
+		using value_type = component;
+		using difference_type = std::ptrdiff_t;
+		using pointer = const component*;
+		using reference = const component&;
+
+		iterator() = default;
+
+		explicit iterator(std::string_view data) : data_(data)
+		{
+			current_.kind = state::PARSE_RESET;
+			++(*this);
+		}
+
+		reference operator*() const { return current_; }
+		pointer operator->() const { return &current_; }
+
+		iterator& operator++()
+		{
+			if (done()) return *this;
+
+			current_.kind = detail::proceed(data_, start_, end_, current_.kind);
+			current_.value = (current_.kind == state::PARSE_ERROR) ? std::string_view() : data_.substr(static_cast<std::size_t>(start_), static_cast<std::size_t>(end_ - start_));
+			return *this;
+		}
+
+		iterator operator++(int)
+		{
+			iterator it = *this;
+			++(*this);
+			return it;
+		}
+
+		bool operator==(const iterator &other) const { return done() == other.done() && (done() || end_ == other.end_); }
+		bool operator!=(const iterator &other) const { return !(*this == other); }
+
+	private:
+		bool done() const { return current_.kind == state::PARSE_DONE || current_.kind == state::PARSE_ERROR; }
+
+		std::string_view data_{};
+		long start_ = 0;
+		long end_ = 0;
+		component current_{};
+	};
+
+	explicit components(std::string_view s) : data_(s) {}
+
+	iterator begin() const { return iterator(data_); }
+	iterator end() const { return iterator(); }
+
+private:
+	std::string_view data_;
+};
+
+/*
+ * Parse at runtime. The view-bounded grammar (checked against the C
+ * engine by the test suite) reads only the bytes of s, with no copy, and
+ * the components are views into s.
+ */
+inline parsed parse(std::string_view s)
+{
+	return detail::parse_constexpr(s);
+}
+
+/*
+ * Parse a URI known at compile time. With consteval an invalid literal
+ * never compiles; before C++20 that holds when the result is used in a
+ * constant expression, and otherwise it throws at runtime.
+ */
+URI_CONSTEVAL parsed literal(std::string_view s)
+{
+	parsed result = detail::parse_constexpr(s);
+
+	if (!result.valid()) throw std::invalid_argument("invalid URI literal");
+	return result;
+}
+
+namespace literals {
+
+URI_CONSTEVAL parsed operator""_uri(const char *s, std::size_t len)
+{
+	return literal(std::string_view(s, len));
+}
+
+} /* namespace literals */
+
+} /* namespace uri */
+
+#endif